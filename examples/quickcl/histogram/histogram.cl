@@ -2,9 +2,15 @@
 
 #pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable
 
+// NUM_PIXELS_PER_WORKITEM is passed as a define when building the program,
+// allowing the compiler to unroll the per-pixel loop.
+#ifndef NUM_PIXELS_PER_WORKITEM
+#define NUM_PIXELS_PER_WORKITEM 32
+#endif
+
 constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
-kernel void histogram(image2d_t img, int num_pixels_per_workitem, global uint *buf)
+kernel void histogram(image2d_t img, global uint *buf)
 {
     int local_size = get_local_size(0) * get_local_size(1);
     int item_offset = get_local_id(0) + get_local_id(1) * get_local_size(0);
@@ -21,7 +27,7 @@ kernel void histogram(image2d_t img, int num_pixels_per_workitem, global uint *b
     barrier(CLK_LOCAL_MEM_FENCE);
 
     int x, image_width = get_image_width(img), image_height = get_image_height(img);
-    for (i = 0, x = get_global_id(0); i < num_pixels_per_workitem; ++i, x += get_global_size(0)) {
+    for (i = 0, x = get_global_id(0); i < NUM_PIXELS_PER_WORKITEM; ++i, x += get_global_size(0)) {
         if (x < image_width && get_global_id(1) < image_height) {
             float4 clr = read_imagef(img, sampler, (int2)(x, get_global_id(1)));
             if (clr.w > 0.99f) {
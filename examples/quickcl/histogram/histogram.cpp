@@ -47,10 +47,13 @@
 #include <QQuickCLItem>
 #include <QQuickCLImageRunnable>
 #include <QQuickCLContext>
+#include <QQuickCLKernel>
 #include <QAbstractListModel>
 
 static bool profile = false;
 
+static const int NUM_PIXELS_PER_ITEM = 32;
+
 class HistogramModel : public QAbstractListModel
 {
     Q_OBJECT
@@ -141,8 +144,8 @@ public:
 private:
     CLItem *m_item;
     cl_program m_program;
-    cl_kernel m_kernel;
-    cl_kernel m_sumKernel;
+    QQuickCLKernel m_kernel;
+    QQuickCLKernel m_sumKernel;
     cl_mem m_resultBuf;
     cl_mem m_sharedBuf;
     cl_event m_doneEvent;
@@ -154,8 +157,6 @@ CLRunnable::CLRunnable(CLItem *item)
     : QQuickCLImageRunnable(item, NoOutputImage | (profile ? Profile : Flag(0))), // note the NoOutputImage flag
       m_item(item),
       m_program(0),
-      m_kernel(0),
-      m_sumKernel(0),
       m_resultBuf(0),
       m_sharedBuf(0),
       m_doneEvent(0)
@@ -163,20 +164,15 @@ CLRunnable::CLRunnable(CLItem *item)
     QQuickCLContext *clctx = m_item->context();
     QByteArray platform = clctx->platformName();
     qDebug("Using platform %s", platform.constData());
-    m_program = clctx->buildProgramFromFile(QStringLiteral(":/histogram.cl"));
+    // Bake the number of pixels per work item into the program.
+    QQuickCLContext::DefineMap defines;
+    defines.insert(QByteArrayLiteral("NUM_PIXELS_PER_WORKITEM"), QByteArray::number(NUM_PIXELS_PER_ITEM));
+    m_program = clctx->buildProgramFromFile(QStringLiteral(":/histogram.cl"), QByteArrayLiteral("-cl-mad-enable"), defines);
     if (!m_program)
         return;
-    cl_int err;
-    m_kernel = clCreateKernel(m_program, "histogram", &err);
-    if (!m_kernel) {
-        qWarning("Failed to create histogram OpenCL kernel: %d", err);
-        return;
-    }
-    m_sumKernel = clCreateKernel(m_program, "sum_histogram", &err);
-    if (!m_sumKernel) {
-        qWarning("Failed to create sum histogram OpenCL kernel: %d", err);
+    if (!m_kernel.create(m_program, "histogram") || !m_sumKernel.create(m_program, "sum_histogram"))
         return;
-    }
+    cl_int err;
     m_resultBuf = clCreateBuffer(clctx->context(), CL_MEM_WRITE_ONLY, 256 * sizeof(cl_uint), 0, &err);
     if (!m_resultBuf) {
         qWarning("Failed to create OpenCL buffer: %d", err);
@@ -191,10 +187,6 @@ CLRunnable::~CLRunnable()
         clReleaseMemObject(m_sharedBuf);
     if (m_resultBuf)
         clReleaseMemObject(m_resultBuf);
-    if (m_kernel)
-        clReleaseKernel(m_kernel);
-    if (m_sumKernel)
-        clReleaseKernel(m_sumKernel);
     if (m_program)
         clReleaseProgram(m_program);
 }
@@ -213,7 +205,7 @@ private:
 
 void CLRunnable::runKernel(cl_mem inImage, cl_mem, const QSize &size)
 {
-    if (!m_program || !m_kernel || !m_sumKernel || !m_resultBuf)
+    if (!m_program || !m_kernel.isValid() || !m_sumKernel.isValid() || !m_resultBuf)
         return;
 
     if (!m_resultPending.testAndSetOrdered(0, 1))
@@ -225,15 +217,11 @@ void CLRunnable::runKernel(cl_mem inImage, cl_mem, const QSize &size)
 
     const size_t group_size_x = 16;
     const size_t group_size_y = 8;
-    const cl_int num_pixels_per_item = 32;
-    const size_t num_items_per_row = DIV(size.width(), num_pixels_per_item);
+    const size_t num_items_per_row = DIV(size.width(), NUM_PIXELS_PER_ITEM);
     const size_t num_groups_x = DIV(num_items_per_row, group_size_x);
     const size_t num_groups_y = DIV(size.height(), group_size_y);
     const cl_int num_groups = cl_int(num_groups_x * num_groups_y);
 
-    const size_t localWorkSize[2] = { group_size_x, group_size_y };
-    const size_t globalWorkSize[2] = { localWorkSize[0] * num_groups_x, localWorkSize[1] * num_groups_y };
-
     cl_int err;
     if (!m_sharedBuf) {
         const size_t sharedBufSize = num_groups * 256 * sizeof(cl_uint);
@@ -244,25 +232,14 @@ void CLRunnable::runKernel(cl_mem inImage, cl_mem, const QSize &size)
         }
     }
 
-    clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &inImage);
-    clSetKernelArg(m_kernel, 1, sizeof(cl_int), &num_pixels_per_item);
-    clSetKernelArg(m_kernel, 2, sizeof(cl_mem), &m_sharedBuf);
-    err = clEnqueueNDRangeKernel(commandQueue(), m_kernel, 2, 0, globalWorkSize, localWorkSize, 0, 0, 0);
-    if (err != CL_SUCCESS) {
-        qWarning("Failed to enqueue kernel: %d", err);
+    const QQuickCLKernel::Range range = QQuickCLKernel::Range(group_size_x * num_groups_x, group_size_y * num_groups_y)
+            .setLocal(group_size_x, group_size_y);
+    if (m_kernel.enqueue(commandQueue(), range, inImage, m_sharedBuf) != CL_SUCCESS)
         return;
-    }
 
-    clSetKernelArg(m_sumKernel, 0, sizeof(cl_mem), &m_sharedBuf);
-    clSetKernelArg(m_sumKernel, 1, sizeof(cl_int), &num_groups);
-    clSetKernelArg(m_sumKernel, 2, sizeof(cl_mem), &m_resultBuf);
-    const size_t sumLocalWorkSize = 256;
-    const size_t sumGlobalWorkSize = 256;
-    err = clEnqueueNDRangeKernel(commandQueue(), m_sumKernel, 1, 0, &sumGlobalWorkSize, &sumLocalWorkSize, 0, 0, 0);
-    if (err != CL_SUCCESS) {
-        qWarning("Failed to enqueue sum kernel: %d", err);
+    if (m_sumKernel.enqueue(commandQueue(), QQuickCLKernel::Range(256).setLocal(256),
+                            m_sharedBuf, num_groups, m_resultBuf) != CL_SUCCESS)
         return;
-    }
 
     err = clEnqueueReadBuffer(commandQueue(), m_resultBuf, CL_FALSE, 0, m_result.size(), m_result.data(), 0, 0, &m_doneEvent);
     if (err != CL_SUCCESS) {
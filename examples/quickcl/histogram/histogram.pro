@@ -1,11 +1,19 @@
 TEMPLATE = app
 
 QT += qml quick quickcl
+CONFIG += c++11
 
 SOURCES = histogram.cpp
 
 RESOURCES = histogram.qrc
 
+# Precompile the kernels at build time. The options and defines must match
+# the ones passed to buildProgramFromFile().
+CONFIG += quickcl_kernels
+QUICKCL_KERNELS = histogram.cl
+QUICKCL_KERNEL_OPTIONS = -cl-mad-enable
+QUICKCL_KERNEL_DEFINES = NUM_PIXELS_PER_WORKITEM=32
+
 OTHER_FILES = $$PWD/qml/histogram.qml
 
 osx {
@@ -47,6 +47,7 @@
 #include <QQuickCLItem>
 #include <QQuickCLImageRunnable>
 #include <QQuickCLContext>
+#include <QQuickCLKernel>
 
 static bool profile = false;
 
@@ -94,11 +95,13 @@ public:
     CLRunnable(CLItem *item);
     ~CLRunnable();
     void runKernel(cl_mem inImage, cl_mem outImage, const QSize &size) Q_DECL_OVERRIDE;
+    void synchronize() Q_DECL_OVERRIDE;
 
 private:
     CLItem *m_item;
-    cl_program m_clProgram;
-    cl_kernel m_clKernel;
+    QQuickCLProgramFuture m_clProgram;
+    QQuickCLKernel m_clKernel;
+    cl_float m_factor;
 };
 
 QQuickCLRunnable *CLItem::createCL()
@@ -116,50 +119,47 @@ static const char *openclSrc =
         "}\n";
 
 CLRunnable::CLRunnable(CLItem *item)
-    : QQuickCLImageRunnable(item, profile ? Profile : Flag(0)),
+    : QQuickCLImageRunnable(item, PassthroughWhilePending | ComputeThread | SkipUnchanged | (profile ? Profile : Flag(0))),
       m_item(item),
-      m_clProgram(0),
-      m_clKernel(0)
+      m_factor(1)
 {
     QQuickCLContext *clctx = m_item->context();
     QByteArray platform = clctx->platformName();
     qDebug("Using platform %s", platform.constData());
-    m_clProgram = clctx->buildProgram(openclSrc);
-    if (!m_clProgram)
-        return;
-    cl_int err;
-    m_clKernel = clCreateKernel(m_clProgram, "Emboss", &err);
-    if (!m_clKernel) {
-        qWarning("Failed to create emboss OpenCL kernel: %d", err);
-        return;
-    }
+    // Let the kernel for the next frame overlap with showing the current one.
+    setPipelineDepth(2);
+    // Build in the background. The source image is shown until the program is ready.
+    m_clProgram = clctx->buildProgramAsync(openclSrc);
+    addPendingProgram(m_clProgram);
 }
 
 CLRunnable::~CLRunnable()
 {
-    if (m_clKernel)
-        clReleaseKernel(m_clKernel);
-    if (m_clProgram)
-        clReleaseProgram(m_clProgram);
 }
 
 void CLRunnable::runKernel(cl_mem inImage, cl_mem outImage, const QSize &size)
 {
-    if (!m_clProgram)
+    if (!m_clProgram.program())
+        return;
+
+    if (!m_clKernel.isValid() && !m_clKernel.create(m_clProgram.program(), "Emboss"))
         return;
 
     if (profile)
         qDebug("CL time: %f", elapsed());
 
-    clSetKernelArg(m_clKernel, 0, sizeof(cl_mem), &inImage);
-    clSetKernelArg(m_clKernel, 1, sizeof(cl_mem), &outImage);
-    const cl_float factor = m_item->factor();
-    clSetKernelArg(m_clKernel, 2, sizeof(cl_float), &factor);
+    m_clKernel.enqueue(commandQueue(), QQuickCLKernel::Range(size), inImage, outImage, m_factor);
+}
 
-    const size_t workSize[] = { size_t(size.width()), size_t(size.height()) };
-    cl_int err = clEnqueueNDRangeKernel(commandQueue(), m_clKernel, 2, 0, workSize, 0, 0, 0, 0);
-    if (err != CL_SUCCESS)
-        qWarning("Failed to enqueue kernel: %d", err);
+void CLRunnable::synchronize()
+{
+    // runKernel() may be called on the compute thread, copy the item's state here.
+    // Unless the factor or the source changes, the previous output is reused.
+    const cl_float factor = m_item->factor();
+    if (m_factor != factor) {
+        m_factor = factor;
+        markDirty();
+    }
 }
 
 int main(int argc, char **argv)
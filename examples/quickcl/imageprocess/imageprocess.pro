@@ -1,6 +1,7 @@
 TEMPLATE = app
 
 QT += qml quick quickcl
+CONFIG += c++11
 
 SOURCES = imageprocess.cpp
 
@@ -50,6 +50,7 @@
 #include <QQuickCLItem>
 #include <QQuickCLRunnable>
 #include <QQuickCLContext>
+#include <QQuickCLKernel>
 #include <time.h>
 
 const int PARTICLE_COUNT = 1024;
@@ -103,6 +104,7 @@ public:
     CLRunnable(CLItem *item);
     ~CLRunnable();
     QSGNode *update(QSGNode *node) Q_DECL_OVERRIDE;
+    void eventCompletedOnRenderThread(cl_event event) Q_DECL_OVERRIDE;
     CLNode *node() const { return m_node; }
     void resetComputeInProgress() { m_computeInProgress.testAndSetOrdered(1, 0); }
 
@@ -119,10 +121,9 @@ private:
     bool m_recreateFbo;
     cl_command_queue m_queue;
     cl_program m_program;
-    cl_kernel m_kernel;
+    QQuickCLKernel m_kernel;
     cl_event m_computeDoneEvent;
     QSize m_itemSize;
-    bool m_needsExplicitSync;
     QAtomicInt m_computeInProgress;
     qreal m_lastT;
     cl_mem m_clBufParticleInfo;
@@ -137,7 +138,6 @@ public:
     CLItem() : m_t(0) { }
 
     QQuickCLRunnable *createCL() Q_DECL_OVERRIDE;
-    void eventCompleted(cl_event event) Q_DECL_OVERRIDE;
 
     qreal t() const { return m_t; }
     void setT(qreal v) {
@@ -153,7 +153,6 @@ signals:
 
 private:
     qreal m_t;
-    CLRunnable *m_runnable;
 };
 
 static const char *vertexShaderSource =
@@ -215,14 +214,14 @@ CLRunnable::CLRunnable(CLItem *item)
       m_node(0),
       m_recreateFbo(false),
       m_program(0),
-      m_kernel(0),
       m_computeDoneEvent(0),
       m_lastT(-1),
       m_clBufParticleInfo(0)
 {
     QQuickCLContext *clctx = m_item->context();
 
-    qDebug() << "Platform" << clctx->platformName() << "Device extensions" << clctx->deviceExtensions();
+    qDebug() << "Platform" << clctx->platformName() << "Device" << clctx->deviceInfo().name()
+             << "Device extensions" << clctx->deviceExtensions();
     cl_int err;
 
     m_queue = clCreateCommandQueue(clctx->context(), clctx->device(), 0, &err);
@@ -234,13 +233,8 @@ CLRunnable::CLRunnable(CLItem *item)
     m_program = clctx->buildProgramFromFile(QStringLiteral(":/particles.cl"));
     if (!m_program)
         return;
-    m_kernel = clCreateKernel(m_program, "updateParticles", &err);
-    if (!m_kernel) {
-        qWarning("Failed to create particles OpenCL kernel: %d", err);
+    if (!m_kernel.create(m_program, "updateParticles"))
         return;
-    }
-
-    m_needsExplicitSync = !clctx->deviceExtensions().contains(QByteArrayLiteral("cl_khr_gl_event"));
 
     // m_clBufParticleInfo is an ordinary OpenCL buffer.
     size_t velBufSize = PARTICLE_COUNT * sizeof(cl_float) * 4;
@@ -270,8 +264,6 @@ CLRunnable::~CLRunnable()
 {
     if (m_clBufParticleInfo)
         clReleaseMemObject(m_clBufParticleInfo);
-    if (m_kernel)
-        clReleaseKernel(m_kernel);
     if (m_program)
         clReleaseProgram(m_program);
     if (m_queue)
@@ -336,7 +328,7 @@ private:
 
 QSGNode *CLRunnable::update(QSGNode *node)
 {
-    if (!m_queue || !m_program || !m_kernel || !m_clBufParticleInfo)
+    if (!m_queue || !m_program || !m_kernel.isValid() || !m_clBufParticleInfo)
         return 0;
 
     if (!node) {
@@ -372,8 +364,8 @@ QSGNode *CLRunnable::update(QSGNode *node)
     cl_float dt = m_item->t() - m_lastT;
     m_lastT = m_item->t();
 
-    if (m_needsExplicitSync)
-        QOpenGLContext::currentContext()->functions()->glFinish();
+    QQuickCLContext *clctx = m_item->context();
+    clctx->syncBeforeAcquire();
 
     cl_int err = clEnqueueAcquireGLObjects(m_queue, 1, &m_node->m_clBuf, 0, 0, 0);
     if (err != CL_SUCCESS) {
@@ -381,17 +373,9 @@ QSGNode *CLRunnable::update(QSGNode *node)
         return node;
     }
 
-    clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &m_node->m_clBuf);
-    cl_float t = m_item->t();
-    clSetKernelArg(m_kernel, 1, sizeof(cl_float), &t);
-    clSetKernelArg(m_kernel, 2, sizeof(cl_float), &dt);
-    clSetKernelArg(m_kernel, 3, sizeof(cl_mem), &m_clBufParticleInfo);
-    size_t globalWorkSize = PARTICLE_COUNT;
-    err = clEnqueueNDRangeKernel(m_queue, m_kernel, 1, 0, &globalWorkSize, 0, 0, 0, 0);
-    if (err != CL_SUCCESS) {
-        qWarning("Failed to enqueue kernel: %d", err);
+    const cl_float t = m_item->t();
+    if (m_kernel.enqueue(m_queue, QQuickCLKernel::Range(PARTICLE_COUNT), m_node->m_clBuf, t, dt, m_clBufParticleInfo) != CL_SUCCESS)
         return node;
-    }
 
     err = clEnqueueReleaseGLObjects(m_queue, 1, &m_node->m_clBuf, 0, 0, &m_computeDoneEvent);
     if (err != CL_SUCCESS) {
@@ -399,28 +383,28 @@ QSGNode *CLRunnable::update(QSGNode *node)
         return node;
     }
 
-    sg.release();
-    m_item->watchEvent(m_computeDoneEvent);
+    clctx->syncAfterRelease(m_queue, m_computeDoneEvent);
 
-    if (m_needsExplicitSync)
-        clFinish(m_queue);
+    // Get notified on the render thread, the results never leave the GPU anyway.
+    sg.release();
+    m_item->watchEvent(m_computeDoneEvent, QQuickCLItem::RenderThread);
 
     return node;
 }
 
-void CLItem::eventCompleted(cl_event event)
+void CLRunnable::eventCompletedOnRenderThread(cl_event event)
 {
+    // Called right before update() in the same synchronization step.
     clReleaseEvent(event);
-    m_runnable->resetComputeInProgress();
+    resetComputeInProgress();
     // Tell the node that the FBO's contents is stale and needs updating.
-    m_runnable->node()->m_renderPending.testAndSetOrdered(0, 1);
-    scheduleUpdate();
+    if (m_node)
+        m_node->m_renderPending.testAndSetOrdered(0, 1);
 }
 
 QQuickCLRunnable *CLItem::createCL()
 {
-    m_runnable = new CLRunnable(this);
-    return m_runnable;
+    return new CLRunnable(this);
 }
 
 int main(int argc, char **argv)
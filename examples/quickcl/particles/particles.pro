@@ -1,11 +1,16 @@
 TEMPLATE = app
 
 QT += qml quick quickcl
+CONFIG += c++11
 
 SOURCES = particles.cpp
 
 RESOURCES = particles.qrc
 
+# Precompile the kernels at build time.
+CONFIG += quickcl_kernels
+QUICKCL_KERNELS = particles.cl
+
 OTHER_FILES = $$PWD/qml/particles.qml
 
 osx {
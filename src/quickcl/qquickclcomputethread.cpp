@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickclcomputethread_p.h"
+#include "qquickclcontext.h"
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QLoggingCategory>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(logCL)
+
+/*
+    A thread per window that owns a command queue and runs the OpenCL work of
+    the items in the window, so that host-side preparation and blocking
+    OpenCL calls do not eat into the frame budget of the render thread.
+
+    Jobs are posted from the render thread. Each job is in the queue at most
+    once; the render thread checks isBusy() before posting again and uses
+    cancel() to wait for a job before touching the resources it uses.
+
+    Items measuring their kernels use a second thread for the window, whose
+    queue has profiling enabled.
+ */
+
+struct QQuickCLComputeThreadRegistry
+{
+    QMutex mutex;
+    QHash<QPair<QQuickWindow *, bool>, QQuickCLComputeThread *> threads; // keyed by window and profiling
+};
+
+Q_GLOBAL_STATIC(QQuickCLComputeThreadRegistry, computeThreadRegistry)
+
+QQuickCLComputeThread::QQuickCLComputeThread(QQuickWindow *window, QQuickCLContext *clctx, bool profiling)
+    : m_window(window),
+      // Profiling has a cost on some implementations, only jobs measuring
+      // their kernels for QQuickCLItem::computeBudget ask for it.
+      m_queue(clctx->createCommandQueue(profiling ? CL_QUEUE_PROFILING_ENABLE : 0)),
+      m_profiling(profiling),
+      m_ref(0),
+      m_current(0),
+      m_quit(false)
+{
+    setObjectName(QStringLiteral("QQuickCLComputeThread"));
+}
+
+QQuickCLComputeThread::~QQuickCLComputeThread()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_quit = true;
+        m_cond.wakeAll();
+    }
+    wait();
+    if (m_queue)
+        clReleaseCommandQueue(m_queue);
+}
+
+/*
+    Returns the compute thread for window, starting it when necessary. When
+    profiling is true, the thread's queue has profiling enabled. Must be
+    called on the render thread. Each call must be balanced by a call to
+    release().
+ */
+QQuickCLComputeThread *QQuickCLComputeThread::acquire(QQuickWindow *window, QQuickCLContext *clctx, bool profiling)
+{
+    QQuickCLComputeThreadRegistry *registry = computeThreadRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QQuickCLComputeThread *t = registry->threads.value(qMakePair(window, profiling));
+    if (!t) {
+        t = new QQuickCLComputeThread(window, clctx, profiling);
+        if (!t->m_queue) {
+            delete t;
+            return 0;
+        }
+        t->start();
+        registry->threads.insert(qMakePair(window, profiling), t);
+        qCDebug(logCL, "Started compute thread for window %p", window);
+    }
+    ++t->m_ref;
+    return t;
+}
+
+void QQuickCLComputeThread::release(QQuickCLComputeThread *thread)
+{
+    if (!thread)
+        return;
+
+    QQuickCLComputeThreadRegistry *registry = computeThreadRegistry();
+    QMutexLocker lock(&registry->mutex);
+    Q_ASSERT(thread->m_ref > 0);
+    if (--thread->m_ref > 0)
+        return;
+    registry->threads.remove(qMakePair(thread->m_window, thread->m_profiling));
+    qCDebug(logCL, "Stopping compute thread for window %p", thread->m_window);
+    lock.unlock();
+    delete thread;
+}
+
+void QQuickCLComputeThread::post(QQuickCLComputeJob *job)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_jobs.contains(job))
+        m_jobs.append(job);
+    m_cond.wakeAll();
+}
+
+/*
+    Returns true when job is queued or running.
+ */
+bool QQuickCLComputeThread::isBusy(QQuickCLComputeJob *job)
+{
+    QMutexLocker lock(&m_mutex);
+    return m_current == job || m_jobs.contains(job);
+}
+
+/*
+    Removes job from the queue, or waits for it to finish when it is already
+    running.
+ */
+void QQuickCLComputeThread::cancel(QQuickCLComputeJob *job)
+{
+    QMutexLocker lock(&m_mutex);
+    m_jobs.removeAll(job);
+    while (m_current == job)
+        m_cond.wait(&m_mutex);
+}
+
+void QQuickCLComputeThread::run()
+{
+    QMutexLocker lock(&m_mutex);
+    forever {
+        while (m_jobs.isEmpty() && !m_quit)
+            m_cond.wait(&m_mutex);
+        if (m_quit)
+            return;
+
+        m_current = m_jobs.takeFirst();
+        lock.unlock();
+        m_current->run(m_queue);
+        lock.relock();
+
+        QQuickCLComputeJob *job = m_current;
+        m_current = 0;
+        job->done(); // still under the lock, cancel() cannot return before this is complete
+        m_cond.wakeAll();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLCOMPUTETHREAD_P_H
+#define QQUICKCLCOMPUTETHREAD_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuickCL/qtquickclglobal.h>
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QQuickWindow;
+class QQuickCLContext;
+
+class QQuickCLComputeJob
+{
+public:
+    virtual ~QQuickCLComputeJob() { }
+
+    // Called on the compute thread.
+    virtual void run(cl_command_queue queue) = 0;
+    // Called on the compute thread after run(), once the job no longer counts as busy.
+    virtual void done() { }
+};
+
+class QQuickCLComputeThread : public QThread
+{
+public:
+    static QQuickCLComputeThread *acquire(QQuickWindow *window, QQuickCLContext *clctx, bool profiling);
+    static void release(QQuickCLComputeThread *thread);
+
+    cl_command_queue commandQueue() const { return m_queue; }
+
+    void post(QQuickCLComputeJob *job);
+    bool isBusy(QQuickCLComputeJob *job);
+    void cancel(QQuickCLComputeJob *job);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QQuickCLComputeThread(QQuickWindow *window, QQuickCLContext *clctx, bool profiling);
+    ~QQuickCLComputeThread();
+
+    QQuickWindow *m_window;
+    cl_command_queue m_queue;
+    bool m_profiling;
+    int m_ref;
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QVector<QQuickCLComputeJob *> m_jobs;
+    QQuickCLComputeJob *m_current;
+    bool m_quit;
+};
+
+QT_END_NAMESPACE
+
+#endif
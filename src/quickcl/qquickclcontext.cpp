@@ -34,11 +34,20 @@
 **
 ****************************************************************************/
 
-#include "qquickclcontext.h"
+#include "qquickclcontext_p.h"
+#include "qquickclprogramfuture_p.h"
 
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QOpenGLFunctions>
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QSaveFile>
+#include <QtCore/QFile>
+#include <QtCore/QDir>
+#include <QtCore/QMutex>
+#include <QtCore/QHash>
+#include <QtCore/QThreadPool>
 #include <qpa/qplatformnativeinterface.h>
 
 QT_BEGIN_NAMESPACE
@@ -52,25 +61,307 @@ Q_LOGGING_CATEGORY(logCL, "qt.quickcl")
 
     \note In most cases there is no need to directly interact with this class
     as QQuickCLItem takes care of creating and destroying a QQuickCLContext
-    instance as necessary.
+    instance as necessary. Items rendered with the same OpenGL context share
+    the same QQuickCLContext instance.
 
     \note This class assumes that OpenCL 1.1 and CL-GL interop are available.
+    For headless use and for devices without CL-GL interop, for example CPU
+    implementations, create the context via createComputeOnly() instead.
+
+    \section1 Program binary cache
+
+    Programs built via buildProgram() and buildProgramFromFile() are cached on
+    disk in binary form. Subsequent builds of the same source for the same
+    platform, device and driver version are then performed via
+    \c clCreateProgramWithBinary, which avoids compiling the source again on
+    every application launch. When the driver rejects a cached binary, the
+    program is built from source and the cache entry is replaced.
+
+    Binaries can also be generated at build time for the OpenCL devices
+    present on the build machine. Add \c quickcl_kernels to \c CONFIG in the
+    application's \c .pro file and list the \c .cl files in \c
+    QUICKCL_KERNELS. The \c qquickclc tool then compiles them and embeds the
+    binaries into the application's resources. These are picked up
+    automatically by buildProgram() and buildProgramFromFile(), as long as the
+    source, the options and the device match.
+
+    \note \c qquickclc runs on the build host but links to QtQuickCL and
+    compiles for the host's OpenCL devices. It is therefore not usable when
+    cross-compiling; applications targeting another device should rely on
+    the runtime cache instead.
+
+    The cache is stored in a \c qtquickcl/programs subdirectory of the
+    application's cache location by default. This can be changed by calling
+    setProgramBinaryCacheDirectory() or by setting the \c
+    QT_QUICKCL_PROGRAM_CACHE_DIR environment variable. Setting \c
+    QT_QUICKCL_DISABLE_PROGRAM_CACHE disables the cache altogether.
  */
 
-class QQuickCLContextPrivate
+struct QQuickCLProgramCacheConfig
 {
-public:
-    QQuickCLContextPrivate()
-        : platform(0),
-          device(0),
-          context(0)
-    { }
-
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_context context;
+    QQuickCLProgramCacheConfig()
+    {
+        if (!qEnvironmentVariableIsEmpty("QT_QUICKCL_DISABLE_PROGRAM_CACHE"))
+            return;
+        path = QString::fromLocal8Bit(qgetenv("QT_QUICKCL_PROGRAM_CACHE_DIR"));
+        if (path.isEmpty()) {
+            const QString cacheLocation = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+            if (!cacheLocation.isEmpty())
+                path = cacheLocation + QStringLiteral("/qtquickcl/programs");
+        }
+    }
+
+    QMutex mutex;
+    QString path;
+};
+
+Q_GLOBAL_STATIC(QQuickCLProgramCacheConfig, programCacheConfig)
+
+struct QQuickCLContextRegistry
+{
+    QMutex mutex;
+    QHash<QOpenGLContext *, QQuickCLContext *> contexts;
 };
 
+Q_GLOBAL_STATIC(QQuickCLContextRegistry, contextRegistry)
+
+/*
+    Returns the QQuickCLContext shared by everything rendering with the current
+    OpenGL context, creating it when necessary. Each successful call must be
+    balanced by a call to releaseShared().
+ */
+QQuickCLContext *QQuickCLContextPrivate::acquireShared()
+{
+    QOpenGLContext *glctx = QOpenGLContext::currentContext();
+    if (!glctx) {
+        qWarning("Attempted to get a shared OpenCL context without a current OpenGL context");
+        return 0;
+    }
+
+    QQuickCLContextRegistry *registry = contextRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QQuickCLContext *c = registry->contexts.value(glctx);
+    if (!c) {
+        c = new QQuickCLContext;
+        if (!c->create()) {
+            delete c;
+            return 0;
+        }
+        c->d_func()->sharedGLContext = glctx;
+        registry->contexts.insert(glctx, c);
+        qCDebug(logCL, "Registered shared OpenCL context %p for OpenGL context %p", c->context(), glctx);
+    }
+    ++c->d_func()->sharedRef;
+    return c;
+}
+
+/*
+    Drops a reference to a context returned from acquireShared(). The context
+    is destroyed when the last reference goes away.
+ */
+void QQuickCLContextPrivate::releaseShared(QQuickCLContext *c)
+{
+    if (!c)
+        return;
+
+    QQuickCLContextRegistry *registry = contextRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QQuickCLContextPrivate *d = c->d_func();
+    Q_ASSERT(d->sharedRef > 0);
+    if (--d->sharedRef > 0)
+        return;
+    registry->contexts.remove(d->sharedGLContext);
+    qCDebug(logCL, "Last user of shared OpenCL context %p gone", d->context);
+    lock.unlock();
+    delete c;
+}
+
+QByteArray QQuickCLContextPrivate::programKey(const QByteArray &src, const QByteArray &options) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(src);
+    hash.addData("\0", 1);
+    hash.addData(options);
+    hash.addData("\0", 1);
+    hash.addData(deviceInfo.platformName());
+    hash.addData("\0", 1);
+    hash.addData(deviceInfo.name());
+    hash.addData("\0", 1);
+    hash.addData(deviceInfo.driverVersion());
+    return hash.result().toHex();
+}
+
+cl_program QQuickCLContextPrivate::buildProgramFromBinary(const QByteArray &binary, const QByteArray &options) const
+{
+    const size_t len = binary.size();
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(binary.constData());
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err;
+    cl_program prog = clCreateProgramWithBinary(context, 1, &device, &len, &data, &binaryStatus, &err);
+    if (!prog || binaryStatus != CL_SUCCESS) {
+        qCDebug(logCL, "Cached program binary rejected (error %d, binary status %d)", err, binaryStatus);
+        if (prog)
+            clReleaseProgram(prog);
+        return 0;
+    }
+    err = clBuildProgram(prog, 1, &device, options.isEmpty() ? 0 : options.constData(), 0, 0);
+    if (err != CL_SUCCESS) {
+        qCDebug(logCL, "Failed to build program from cached binary: %d", err);
+        clReleaseProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+QByteArray QQuickCLContextPrivate::programBinary(cl_program prog)
+{
+    size_t size = 0;
+    cl_int err = clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, 0);
+    if (err != CL_SUCCESS || !size) {
+        qCDebug(logCL, "Program binary not available: %d", err);
+        return QByteArray();
+    }
+    QByteArray binary;
+    binary.resize(int(size));
+    unsigned char *data = reinterpret_cast<unsigned char *>(binary.data());
+    err = clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &data, 0);
+    if (err != CL_SUCCESS) {
+        qCDebug(logCL, "Failed to get program binary: %d", err);
+        return QByteArray();
+    }
+    return binary;
+}
+
+void QQuickCLContextPrivate::storeProgramBinary(cl_program prog, const QByteArray &key) const
+{
+    QQuickCLProgramCacheConfig *config = programCacheConfig();
+    QString path;
+    {
+        QMutexLocker lock(&config->mutex);
+        path = config->path;
+    }
+    if (path.isEmpty())
+        return;
+
+    const QByteArray binary = programBinary(prog);
+    if (binary.isEmpty())
+        return;
+
+    if (!QDir().mkpath(path)) {
+        qWarning("Failed to create program binary cache directory %s", qPrintable(path));
+        return;
+    }
+    QSaveFile f(path + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".bin"));
+    if (!f.open(QIODevice::WriteOnly) || f.write(binary) != binary.size() || !f.commit()) {
+        qWarning("Failed to write program binary cache file %s", qPrintable(f.fileName()));
+        return;
+    }
+    qCDebug(logCL, "Stored program binary %s (%d bytes)", key.constData(), binary.size());
+}
+
+cl_program QQuickCLContextPrivate::compileProgram(const QByteArray &src, const QByteArray &options) const
+{
+    const QByteArray key = programKey(src, options);
+
+    // Binaries precompiled at build time via the quickcl_kernels qmake feature.
+    QFile embeddedFile(QStringLiteral(":/qt-project.org/quickcl/programs/") + QString::fromLatin1(key)
+                       + QStringLiteral(".bin"));
+    if (embeddedFile.open(QIODevice::ReadOnly)) {
+        cl_program prog = buildProgramFromBinary(embeddedFile.readAll(), options);
+        if (prog) {
+            qCDebug(logCL, "Using embedded program binary %s", key.constData());
+            return prog;
+        }
+    }
+
+    QString cachePath = QQuickCLContext::programBinaryCacheDirectory();
+    if (!cachePath.isEmpty()) {
+        QFile cacheFile(cachePath + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".bin"));
+        if (cacheFile.open(QIODevice::ReadOnly)) {
+            cl_program prog = buildProgramFromBinary(cacheFile.readAll(), options);
+            cacheFile.close();
+            if (prog) {
+                qCDebug(logCL, "Using cached program binary %s", key.constData());
+                return prog;
+            }
+            cacheFile.remove();
+        }
+    }
+
+    cl_int err;
+    const char *str = src.constData();
+    cl_program prog = clCreateProgramWithSource(context, 1, &str, 0, &err);
+    if (!prog) {
+        qWarning("Failed to create OpenCL program: %d", err);
+        qWarning("Source was:\n%s", str);
+        return 0;
+    }
+    err = clBuildProgram(prog, 1, &device, options.isEmpty() ? 0 : options.constData(), 0, 0);
+    if (err != CL_SUCCESS) {
+        qWarning("Failed to build OpenCL program: %d", err);
+        qWarning("Source was:\n%s", str);
+        if (!options.isEmpty())
+            qWarning("Build options were: %s", options.constData());
+        QByteArray log;
+        log.resize(8192);
+        clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, log.size(), log.data(), 0);
+        qWarning("Build log:\n%s", log.constData());
+        clReleaseProgram(prog);
+        return 0;
+    }
+    storeProgramBinary(prog, key);
+    return prog;
+}
+
+QQuickCLProgramVariants::~QQuickCLProgramVariants()
+{
+    for (QHash<QByteArray, cl_program>::const_iterator it = programs.constBegin(); it != programs.constEnd(); ++it)
+        clReleaseProgram(it.value());
+}
+
+cl_program QQuickCLProgramVariants::find(const QByteArray &key)
+{
+    QMutexLocker lock(&mutex);
+    cl_program prog = programs.value(key);
+    if (prog)
+        clRetainProgram(prog);
+    return prog;
+}
+
+cl_program QQuickCLProgramVariants::insert(const QByteArray &key, cl_program prog)
+{
+    QMutexLocker lock(&mutex);
+    cl_program existing = programs.value(key);
+    if (existing) {
+        // Another thread built the same variant in the meantime.
+        clReleaseProgram(prog);
+        prog = existing;
+    } else {
+        programs.insert(key, prog);
+    }
+    clRetainProgram(prog);
+    return prog;
+}
+
+/*
+    Returns the program for the given source and options, compiling it only
+    when the variant is not yet built. The caller owns a reference to the
+    result, another one is kept in the variant cache.
+ */
+cl_program QQuickCLContextPrivate::buildProgram(const QByteArray &src, const QByteArray &options) const
+{
+    const QByteArray key = QCryptographicHash::hash(src, QCryptographicHash::Sha1) + options;
+    cl_program prog = variants->find(key);
+    if (prog) {
+        qCDebug(logCL, "Reusing already built program variant");
+        return prog;
+    }
+    prog = compileProgram(src, options);
+    if (prog)
+        prog = variants->insert(key, prog);
+    return prog;
+}
+
 /*!
     Constructs a new instance of QQuickCLContext.
 
@@ -142,6 +433,33 @@ cl_context QQuickCLContext::context() const
     return d->context;
 }
 
+static bool getPlatformIds(QVector<cl_platform_id> *platformIds)
+{
+    cl_uint n;
+    cl_int err = clGetPlatformIDs(0, 0, &n);
+    if (err != CL_SUCCESS) {
+        qWarning("Failed to get platform ID count (error %d)", err);
+        if (err == -1001) {
+            qWarning("Could not find OpenCL implementation. ICD missing?"
+#ifdef Q_OS_LINUX
+                     " Check /etc/OpenCL/vendors."
+#endif
+                    );
+        }
+        return false;
+    }
+    if (n == 0) {
+        qWarning("No OpenCL platform found");
+        return false;
+    }
+    platformIds->resize(n);
+    if (clGetPlatformIDs(n, platformIds->data(), 0) != CL_SUCCESS) {
+        qWarning("Failed to get platform IDs");
+        return false;
+    }
+    return true;
+}
+
 /*!
     Creates a new OpenCL context.
 
@@ -154,6 +472,8 @@ cl_context QQuickCLContext::context() const
     If something fails, warnings are logged with the \c qt.quickcl category.
 
     \return \c true if successful.
+
+    \sa createComputeOnly()
  */
 bool QQuickCLContext::create()
 {
@@ -169,29 +489,11 @@ bool QQuickCLContext::create()
     }
     QOpenGLFunctions *f = ctx->functions();
 
-    cl_uint n;
-    cl_int err = clGetPlatformIDs(0, 0, &n);
-    if (err != CL_SUCCESS) {
-        qWarning("Failed to get platform ID count (error %d)", err);
-        if (err == -1001) {
-            qWarning("Could not find OpenCL implementation. ICD missing?"
-#ifdef Q_OS_LINUX
-                     " Check /etc/OpenCL/vendors."
-#endif
-                    );
-        }
-        return false;
-    }
-    if (n == 0) {
-        qWarning("No OpenCL platform found");
-        return false;
-    }
     QVector<cl_platform_id> platformIds;
-    platformIds.resize(n);
-    if (clGetPlatformIDs(n, platformIds.data(), 0) != CL_SUCCESS) {
-        qWarning("Failed to get platform IDs");
+    if (!getPlatformIds(&platformIds))
         return false;
-    }
+    const cl_uint n = platformIds.count();
+    cl_int err;
     d->platform = platformIds[0];
     const char *vendor = (const char *) f->glGetString(GL_VENDOR);
     qCDebug(logCL, "GL_VENDOR: %s", vendor);
@@ -282,9 +584,187 @@ bool QQuickCLContext::create()
 #endif
     qCDebug(logCL, "Using device %p", d->device);
 
+    d->deviceInfo = QQuickCLDeviceInfo::query(d->platform, d->device);
+    d->queryImageFormats();
+    d->glInterop = true;
+    d->chooseSyncMethod(ctx);
+    return true;
+}
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_TIMEOUT_IGNORED
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+static const char *syncMethodName(QQuickCLContext::SyncMethod method)
+{
+    switch (method) {
+    case QQuickCLContext::ImplicitSync:
+        return "implicit";
+    case QQuickCLContext::ARBCLEventSync:
+        return "arbclevent";
+    default:
+        return "finish";
+    }
+}
+
+void QQuickCLContextPrivate::chooseSyncMethod(QOpenGLContext *ctx)
+{
+    syncFuncs = QQuickCLSyncFunctions();
+
+    const QSurfaceFormat format = ctx->format();
+    const int version = format.majorVersion() * 10 + format.minorVersion();
+    const bool hasSync = ctx->isOpenGLES() ? version >= 30
+                                            : (version >= 32 || ctx->hasExtension(QByteArrayLiteral("GL_ARB_sync")));
+    if (hasSync) {
+        syncFuncs.fenceSync = reinterpret_cast<QQuickCLGLsync (QOPENGLF_APIENTRYP)(GLenum, GLbitfield)>(
+                    ctx->getProcAddress(QByteArrayLiteral("glFenceSync")));
+        syncFuncs.clientWaitSync = reinterpret_cast<GLenum (QOPENGLF_APIENTRYP)(QQuickCLGLsync, GLbitfield, quint64)>(
+                    ctx->getProcAddress(QByteArrayLiteral("glClientWaitSync")));
+        syncFuncs.waitSync = reinterpret_cast<void (QOPENGLF_APIENTRYP)(QQuickCLGLsync, GLbitfield, quint64)>(
+                    ctx->getProcAddress(QByteArrayLiteral("glWaitSync")));
+        syncFuncs.deleteSync = reinterpret_cast<void (QOPENGLF_APIENTRYP)(QQuickCLGLsync)>(
+                    ctx->getProcAddress(QByteArrayLiteral("glDeleteSync")));
+        if (ctx->hasExtension(QByteArrayLiteral("GL_ARB_cl_event")))
+            syncFuncs.createSyncFromCLevent = reinterpret_cast<QQuickCLGLsync (QOPENGLF_APIENTRYP)(cl_context, cl_event, GLbitfield)>(
+                        ctx->getProcAddress(QByteArrayLiteral("glCreateSyncFromCLeventARB")));
+    }
+    if (deviceInfo.hasExtension(QQuickCLDeviceInfo::GLEvent))
+        syncFuncs.createEventFromGLsync = reinterpret_cast<cl_event (CL_API_CALL *)(cl_context, QQuickCLGLsync, cl_int *)>(
+                    clGetExtensionFunctionAddress("clCreateEventFromGLsyncKHR"));
+    const bool fenceAvailable = syncFuncs.fenceSync && syncFuncs.clientWaitSync && syncFuncs.waitSync && syncFuncs.deleteSync;
+
+    bool available[QQuickCLContext::FinishSync + 1];
+    available[QQuickCLContext::ImplicitSync] = deviceInfo.hasExtension(QQuickCLDeviceInfo::GLEvent);
+    available[QQuickCLContext::ARBCLEventSync] = fenceAvailable && syncFuncs.createSyncFromCLevent;
+    available[QQuickCLContext::FinishSync] = true;
+
+    // The cheapest mechanism wins. The enum is ordered accordingly.
+    syncMethod = QQuickCLContext::FinishSync;
+    for (int i = QQuickCLContext::FinishSync; i >= QQuickCLContext::ImplicitSync; --i) {
+        if (available[i])
+            syncMethod = QQuickCLContext::SyncMethod(i);
+    }
+
+    const QByteArray requested = qgetenv("QT_QUICKCL_SYNC");
+    if (!requested.isEmpty()) {
+        bool found = false;
+        for (int i = QQuickCLContext::ImplicitSync; i <= QQuickCLContext::FinishSync; ++i) {
+            if (requested == syncMethodName(QQuickCLContext::SyncMethod(i))) {
+                found = true;
+                if (available[i])
+                    syncMethod = QQuickCLContext::SyncMethod(i);
+                else
+                    qWarning("GL-CL synchronization method %s is not supported", requested.constData());
+            }
+        }
+        if (!found)
+            qWarning("Unknown GL-CL synchronization method %s", requested.constData());
+    }
+
+    qCDebug(logCL, "Using GL-CL synchronization method: %s", syncMethodName(syncMethod));
+}
+
+static const cl_mem_flags imageFormatAccess[3] = { CL_MEM_READ_WRITE, CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY };
+
+// Caches the supported 2D image formats per access mode, so that validating
+// a format does not need a round trip to the driver.
+void QQuickCLContextPrivate::queryImageFormats()
+{
+    for (int i = 0; i < 3; ++i) {
+        imageFormats[i].clear();
+        cl_uint count = 0;
+        cl_int err = clGetSupportedImageFormats(context, imageFormatAccess[i], CL_MEM_OBJECT_IMAGE2D, 0, 0, &count);
+        if (err != CL_SUCCESS || !count)
+            continue;
+        imageFormats[i].resize(count);
+        err = clGetSupportedImageFormats(context, imageFormatAccess[i], CL_MEM_OBJECT_IMAGE2D, count,
+                                         imageFormats[i].data(), 0);
+        if (err != CL_SUCCESS) {
+            qWarning("Failed to get supported image formats: %d", err);
+            imageFormats[i].clear();
+        }
+    }
+}
+
+bool QQuickCLContextPrivate::createComputeOnly(cl_platform_id p, cl_device_id dev)
+{
+    platform = p;
+    device = dev;
+    qCDebug(logCL, "Using platform %p", platform);
+
+    cl_context_properties contextProps[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform,
+                                             0 };
+    cl_int err;
+    context = clCreateContext(contextProps, 1, &device, 0, 0, &err);
+    if (!context) {
+        qWarning("Failed to create OpenCL context: %d", err);
+        platform = 0;
+        device = 0;
+        return false;
+    }
+    qCDebug(logCL, "Using context %p", context);
+    qCDebug(logCL, "Using device %p", device);
+
+    deviceInfo = QQuickCLDeviceInfo::query(platform, device);
+    queryImageFormats();
+    glInterop = false;
     return true;
 }
 
+/*!
+    Creates a new OpenCL context without CL-GL interop.
+
+    If a context was already created, it is destroyed first.
+
+    Unlike create(), this function does not need a current OpenGL context and
+    accepts any kind of device. The first platform that has a device matching
+    \a deviceType is used, for example \c CL_DEVICE_TYPE_CPU to run on
+    CPU-only implementations, or \c CL_DEVICE_TYPE_ALL to take whatever is
+    available. This makes it possible to use buildProgram() and
+    createCommandQueue() in headless environments, for batch jobs and in
+    automated tests.
+
+    OpenCL objects cannot be created from OpenGL resources with a compute-only
+    context. Therefore it is not suitable for QQuickCLImageRunnable.
+
+    \return \c true if successful.
+
+    \sa create(), hasGLInterop()
+ */
+bool QQuickCLContext::createComputeOnly(cl_device_type deviceType)
+{
+    Q_D(QQuickCLContext);
+
+    destroy();
+    qCDebug(logCL, "Creating new compute-only OpenCL context");
+
+    QVector<cl_platform_id> platformIds;
+    if (!getPlatformIds(&platformIds))
+        return false;
+
+    cl_int err = CL_DEVICE_NOT_FOUND;
+    for (int i = 0; i < platformIds.count(); ++i) {
+        cl_device_id device;
+        err = clGetDeviceIDs(platformIds[i], deviceType, 1, &device, 0);
+        if (err == CL_SUCCESS)
+            return d->createComputeOnly(platformIds[i], device);
+    }
+    qWarning("Failed to find an OpenCL device of type 0x%x: %d", uint(deviceType), err);
+    return false;
+}
+
 /*!
     Releases all OpenCL resources.
  */
@@ -293,11 +773,233 @@ void QQuickCLContext::destroy()
     Q_D(QQuickCLContext);
     if (d->context) {
         qCDebug(logCL, "Releasing OpenCL context %p", d->context);
+        d->variants.reset(new QQuickCLProgramVariants);
         clReleaseContext(d->context);
         d->context = 0;
     }
     d->device = 0;
     d->platform = 0;
+    d->glInterop = false;
+    d->deviceInfo = QQuickCLDeviceInfo();
+    for (int i = 0; i < 3; ++i)
+        d->imageFormats[i].clear();
+    d->syncMethod = ImplicitSync;
+    d->syncFuncs = QQuickCLSyncFunctions();
+}
+
+/*!
+    \return \c true if the context was created with CL-GL interop enabled via
+    create(), \c false if it was created via createComputeOnly() or not at
+    all.
+ */
+bool QQuickCLContext::hasGLInterop() const
+{
+    Q_D(const QQuickCLContext);
+    return d->glInterop;
+}
+
+/*
+    Inserts a fence after the pending OpenGL commands and returns an OpenCL
+    event for it that the acquire has to wait for, so that neither thread
+    blocks. fence receives the sync object, which must be deleted via
+    deleteGLFence() once the acquire has completed. Returns 0 when
+    clCreateEventFromGLsyncKHR is not available or failed.
+ */
+cl_event QQuickCLContextPrivate::fenceEvent(QQuickCLGLsync *fence)
+{
+    *fence = 0;
+    if (!syncFuncs.createEventFromGLsync || !syncFuncs.fenceSync || !syncFuncs.deleteSync)
+        return 0;
+
+    QQuickCLGLsync sync = syncFuncs.fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (!sync)
+        return 0;
+
+    cl_int err;
+    cl_event event = syncFuncs.createEventFromGLsync(context, sync, &err);
+    if (!event) {
+        qWarning("Failed to create OpenCL event from OpenGL fence: %d", err);
+        syncFuncs.deleteSync(sync);
+        return 0;
+    }
+
+    QOpenGLContext::currentContext()->functions()->glFlush();
+    *fence = sync;
+    return event;
+}
+
+/*
+    Waits on the CPU for a fence inserted after the pending OpenGL commands.
+    Returns false when no fence could be created or waited for, the caller
+    has to fall back to glFinish() then.
+ */
+bool QQuickCLContextPrivate::waitForFence()
+{
+    if (!syncFuncs.fenceSync || !syncFuncs.clientWaitSync || !syncFuncs.deleteSync)
+        return false;
+
+    QQuickCLGLsync sync = syncFuncs.fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (!sync) {
+        qWarning("Failed to create OpenGL fence");
+        return false;
+    }
+
+    const GLenum result = syncFuncs.clientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    syncFuncs.deleteSync(sync);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+        qWarning("Failed to wait for OpenGL fence: 0x%x", result);
+        return false;
+    }
+    return true;
+}
+
+/*
+    Like syncBeforeAcquire(), but for acquiring on a thread other than the one
+    with the OpenGL context current, where the implicit synchronization of
+    cl_khr_gl_event does not apply. When possible, a fence is inserted and an
+    OpenCL event for it is returned that the acquire has to wait for. fence
+    receives the sync object, which must be deleted via deleteGLFence() once
+    the acquire has completed. Otherwise the pending OpenGL commands are
+    waited for on the CPU and 0 is returned.
+ */
+cl_event QQuickCLContextPrivate::syncBeforeAcquireOnOtherThread(QQuickCLGLsync *fence)
+{
+    cl_event event = fenceEvent(fence);
+    if (event)
+        return event;
+
+    if (syncMethod == QQuickCLContext::ImplicitSync)
+        QOpenGLContext::currentContext()->functions()->glFinish();
+    else
+        syncBeforeAcquire();
+    return 0;
+}
+
+void QQuickCLContextPrivate::deleteGLFence(QQuickCLGLsync fence)
+{
+    if (fence && syncFuncs.deleteSync)
+        syncFuncs.deleteSync(fence);
+}
+
+/*!
+    \enum QQuickCLContext::SyncMethod
+
+    Specifies how OpenGL and OpenCL operations on shared objects are
+    synchronized. The values are ordered from cheapest to most expensive.
+
+    \value ImplicitSync \c cl_khr_gl_event is supported, acquiring and
+    releasing the OpenGL objects synchronizes implicitly. No additional work
+    is needed. This is also the value for contexts without CL-GL interop.
+
+    \value ARBCLEventSync \c GL_ARB_cl_event is supported. OpenGL waits for
+    the OpenCL commands on the GPU via a sync object created from the release
+    event, without blocking the CPU. Before acquiring, the CPU still waits for
+    a fence inserted after the OpenGL commands, which costs about as much as
+    \c glFinish().
+
+    \value FinishSync The fallback: \c glFinish() before acquiring and \c
+    clFinish() after releasing.
+ */
+
+/*!
+    \return the mechanism used by syncBeforeAcquire() and syncAfterRelease().
+
+    The cheapest supported method is chosen in create(). For testing
+    purposes, a more expensive method can be requested by setting the
+    environment variable \c QT_QUICKCL_SYNC to \c implicit, \c arbclevent
+    or \c finish. The choice is printed in the \c qt.quickcl
+    logging category.
+ */
+QQuickCLContext::SyncMethod QQuickCLContext::syncMethod() const
+{
+    Q_D(const QQuickCLContext);
+    return d->syncMethod;
+}
+
+/*!
+    Ensures that the pending OpenGL commands that operate on objects shared
+    with OpenCL are complete before the objects are acquired with \c
+    clEnqueueAcquireGLObjects().
+
+    Must be called on the thread where the OpenGL context used in create() is
+    current, typically the render thread.
+ */
+void QQuickCLContext::syncBeforeAcquire()
+{
+    Q_D(QQuickCLContext);
+    d->syncBeforeAcquire();
+}
+
+void QQuickCLContextPrivate::syncBeforeAcquire()
+{
+    switch (syncMethod) {
+    case QQuickCLContext::ImplicitSync:
+        break;
+    case QQuickCLContext::ARBCLEventSync:
+        if (waitForFence())
+            break;
+        // fall through
+    default:
+        QOpenGLContext::currentContext()->functions()->glFinish();
+        break;
+    }
+}
+
+/*!
+    Ensures that OpenGL does not use the objects released with \c
+    clEnqueueReleaseGLObjects() before the OpenCL commands operating on them
+    complete. \a queue is the command queue and \a releaseEvent is the event
+    returned from \c clEnqueueReleaseGLObjects(), if any. Without an event the
+    entire queue is waited for.
+
+    Must be called on the thread where the OpenGL context used in create() is
+    current, typically the render thread.
+
+    \note \a releaseEvent is not released.
+ */
+void QQuickCLContext::syncAfterRelease(cl_command_queue queue, cl_event releaseEvent)
+{
+    Q_D(QQuickCLContext);
+    switch (d->syncMethod) {
+    case ImplicitSync:
+        break;
+    case ARBCLEventSync:
+        if (releaseEvent) {
+            QQuickCLGLsync sync = d->syncFuncs.createSyncFromCLevent(d->context, releaseEvent, 0);
+            if (sync) {
+                clFlush(queue);
+                d->syncFuncs.waitSync(sync, 0, GL_TIMEOUT_IGNORED);
+                d->syncFuncs.deleteSync(sync);
+                break;
+            }
+            qWarning("Failed to create OpenGL sync object from OpenCL event");
+        }
+        clFinish(queue);
+        break;
+    default:
+        clFinish(queue);
+        break;
+    }
+}
+
+/*!
+    Creates a new command queue for the context's device with the given
+    \a properties. The caller owns the returned queue and must release it with
+    \c clReleaseCommandQueue().
+
+    \return the queue or \c 0 when failed.
+
+    \note The value is valid only after create() or createComputeOnly() has
+    been called successfully.
+ */
+cl_command_queue QQuickCLContext::createCommandQueue(cl_command_queue_properties properties)
+{
+    Q_D(QQuickCLContext);
+    cl_int err;
+    cl_command_queue queue = clCreateCommandQueue(d->context, d->device, properties, &err);
+    if (!queue)
+        qWarning("Failed to create OpenCL command queue: %d", err);
+    return queue;
 }
 
 /*!
@@ -312,10 +1014,8 @@ void QQuickCLContext::destroy()
  */
 QByteArray QQuickCLContext::platformName() const
 {
-    QByteArray name(1024, '\0');
-    clGetPlatformInfo(platform(), CL_PLATFORM_NAME, name.size(), name.data(), 0);
-    name.resize(int(strlen(name.constData())));
-    return name;
+    Q_D(const QQuickCLContext);
+    return d->deviceInfo.platformName();
 }
 
 /*!
@@ -330,10 +1030,27 @@ QByteArray QQuickCLContext::platformName() const
  */
 QByteArray QQuickCLContext::deviceExtensions() const
 {
-    QByteArray ext(8192, '\0');
-    clGetDeviceInfo(device(), CL_DEVICE_EXTENSIONS, ext.size(), ext.data(), 0);
-    ext.resize(int(strlen(ext.constData())));
-    return ext;
+    Q_D(const QQuickCLContext);
+    return d->deviceInfo.extensionString();
+}
+
+/*!
+    \return the capabilities of the device in use.
+
+    The information is queried once in create() or createComputeOnly(), so
+    calling this function is cheap.
+
+    \note The value is valid only after create() has been called successfully.
+
+    \note For contexts belonging to a QQuickCLItem this function can only be
+    called from a QQuickCLRunnable's constructor, destructor and
+    \l{QQuickCLRunnable::update()}{update()} function, or after the item has
+    been rendered at least once.
+ */
+const QQuickCLDeviceInfo &QQuickCLContext::deviceInfo() const
+{
+    Q_D(const QQuickCLContext);
+    return d->deviceInfo;
 }
 
 /*!
@@ -349,30 +1066,135 @@ QByteArray QQuickCLContext::deviceExtensions() const
     \l{QQuickCLRunnable::update()}{update()} function, or after the item has
     been rendered at least once.
 
-    \sa buildProgramFromFile()
+    \sa buildProgramFromFile(), setProgramBinaryCacheDirectory()
  */
 cl_program QQuickCLContext::buildProgram(const QByteArray &src)
 {
-    cl_int err;
-    const char *str = src.constData();
-    cl_program prog = clCreateProgramWithSource(context(), 1, &str, 0, &err);
-    if (!prog) {
-        qWarning("Failed to create OpenCL program: %d", err);
-        qWarning("Source was:\n%s", str);
-        return 0;
+    Q_D(QQuickCLContext);
+    return d->buildProgram(src, QByteArray());
+}
+
+/*!
+    \typedef QQuickCLContext::DefineMap
+
+    Synonym for QMap<QByteArray, QByteArray>. Maps preprocessor macro names to
+    their values.
+ */
+
+/*!
+    Creates and builds an OpenCL program from the source code in \a src,
+    passing \a options and \a defines to the OpenCL compiler.
+
+    \a options can contain any option accepted by \c clBuildProgram(), for
+    example \c{-cl-fast-relaxed-math} or \c{-cl-mad-enable}. Each entry in
+    \a defines is turned into a \c{-D name=value} option. This allows baking
+    constants, like image dimensions or loop counts, into the program so that
+    the compiler can fold and unroll them.
+
+    Each variant, meaning each combination of source and options, is compiled
+    only once. Subsequent requests for the same variant return the already
+    built program, including requests coming from other items sharing the
+    same context. As with buildProgram(), the caller owns the returned
+    reference and must release it with \c clReleaseProgram().
+
+    \return the cl_program or \c 0 when failed. Errors and build logs are
+    printed to the warning output.
+
+    \note The value is valid only after create() has been called successfully.
+
+    \sa buildOptions()
+ */
+cl_program QQuickCLContext::buildProgram(const QByteArray &src, const QByteArray &options, const DefineMap &defines)
+{
+    Q_D(QQuickCLContext);
+    return d->buildProgram(src, buildOptions(options, defines));
+}
+
+/*!
+    \return the option string passed to \c clBuildProgram() for the given
+    \a options and \a defines.
+ */
+QByteArray QQuickCLContext::buildOptions(const QByteArray &options, const DefineMap &defines)
+{
+    QByteArray result = options.trimmed();
+    for (DefineMap::const_iterator it = defines.constBegin(); it != defines.constEnd(); ++it) {
+        if (!result.isEmpty())
+            result += ' ';
+        result += QByteArrayLiteral("-D");
+        result += it.key();
+        if (!it.value().isEmpty()) {
+            result += '=';
+            result += it.value();
+        }
     }
-    cl_device_id dev = device();
-    err = clBuildProgram(prog, 1, &dev, 0, 0, 0);
-    if (err != CL_SUCCESS) {
-        qWarning("Failed to build OpenCL program: %d", err);
-        qWarning("Source was:\n%s", str);
-        QByteArray log;
-        log.resize(8192);
-        clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, log.size(), log.data(), 0);
-        qWarning("Build log:\n%s", log.constData());
-        return 0;
+    return result;
+}
+
+class QQuickCLProgramBuildJob : public QRunnable
+{
+public:
+    QQuickCLProgramBuildJob(const QQuickCLContextPrivate *c, const QByteArray &src, const QByteArray &options,
+                            QQuickCLProgramFuturePrivate *future)
+        : src(src), options(options), future(future)
+    {
+        // Work on a copy holding a reference to the cl_context so that the
+        // QQuickCLContext may go away while the build is still running.
+        target.platform = c->platform;
+        target.device = c->device;
+        target.context = c->context;
+        target.deviceInfo = c->deviceInfo;
+        target.variants = c->variants;
+        clRetainContext(target.context);
     }
-    return prog;
+    ~QQuickCLProgramBuildJob() {
+        clReleaseContext(target.context);
+    }
+    void run() Q_DECL_OVERRIDE {
+        future->finish(target.buildProgram(src, options));
+    }
+private:
+    QQuickCLContextPrivate target;
+    QByteArray src;
+    QByteArray options;
+    QExplicitlySharedDataPointer<QQuickCLProgramFuturePrivate> future;
+};
+
+/*!
+    Starts building an OpenCL program from the source code in \a src with
+    the given \a options and \a defines on a worker thread and returns
+    immediately.
+
+    Unlike buildProgram(), this function does not stall the calling thread -
+    typically the scenegraph's render thread - while the driver is compiling.
+    Use the returned QQuickCLProgramFuture to query the state of the build and
+    to get the program once it is ready.
+
+    The program binary cache and the variant cache are used the same way as
+    with buildProgram(). When the variant is already built, the returned
+    future is finished right away.
+
+    \note The value is valid only after create() has been called successfully.
+
+    \sa buildProgram(), QQuickCLProgramFuture::notifyWhenFinished()
+ */
+QQuickCLProgramFuture QQuickCLContext::buildProgramAsync(const QByteArray &src, const QByteArray &options,
+                                                         const DefineMap &defines)
+{
+    Q_D(QQuickCLContext);
+    QQuickCLProgramFuturePrivate *future = new QQuickCLProgramFuturePrivate;
+    if (!d->context) {
+        qWarning("Attempted to build an OpenCL program without a context");
+        future->finish(0);
+        return QQuickCLProgramFuture(future);
+    }
+    const QByteArray allOptions = buildOptions(options, defines);
+    const QByteArray key = QCryptographicHash::hash(src, QCryptographicHash::Sha1) + allOptions;
+    if (cl_program prog = d->variants->find(key)) {
+        future->finish(prog);
+        return QQuickCLProgramFuture(future);
+    }
+    QThreadPool::globalInstance()->start(new QQuickCLProgramBuildJob(d, src, allOptions, future));
+    return QQuickCLProgramFuture(future);
 }
 
 /*!
@@ -388,13 +1210,54 @@ cl_program QQuickCLContext::buildProgram(const QByteArray &src)
     \sa buildProgram()
  */
 cl_program QQuickCLContext::buildProgramFromFile(const QString &filename)
+{
+    return buildProgramFromFile(filename, QByteArray());
+}
+
+/*!
+    Creates and builds an OpenCL program from the source file \a filename,
+    passing \a options and \a defines to the OpenCL compiler.
+
+    \sa buildProgram()
+ */
+cl_program QQuickCLContext::buildProgramFromFile(const QString &filename, const QByteArray &options,
+                                                 const DefineMap &defines)
 {
     QFile f(filename);
     if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
         qWarning("Failed to open OpenCL program source file %s", qPrintable(filename));
         return 0;
     }
-    return buildProgram(f.readAll());
+    return buildProgram(f.readAll(), options, defines);
+}
+
+/*!
+    Sets the directory where program binaries are cached to \a path. Passing
+    an empty string disables the cache.
+
+    The setting affects all QQuickCLContext instances and should typically be
+    applied before the first item gets rendered.
+
+    \sa programBinaryCacheDirectory()
+ */
+void QQuickCLContext::setProgramBinaryCacheDirectory(const QString &path)
+{
+    QQuickCLProgramCacheConfig *config = programCacheConfig();
+    QMutexLocker lock(&config->mutex);
+    config->path = path;
+}
+
+/*!
+    \return the directory where program binaries are cached or an empty string
+    when the cache is disabled.
+
+    \sa setProgramBinaryCacheDirectory()
+ */
+QString QQuickCLContext::programBinaryCacheDirectory()
+{
+    QQuickCLProgramCacheConfig *config = programCacheConfig();
+    QMutexLocker lock(&config->mutex);
+    return config->path;
 }
 
 /*!
@@ -458,4 +1321,32 @@ cl_image_format QQuickCLContext::toCLImageFormat(QImage::Format format)
     return fmt;
 }
 
+/*!
+    \return \c true if 2D images with the given \a format can be created with
+    the access specified in \a flags, which must be one of \c
+    CL_MEM_READ_WRITE, \c CL_MEM_READ_ONLY or \c CL_MEM_WRITE_ONLY.
+
+    The list of supported formats is queried once in create() or
+    createComputeOnly(), so calling this function is cheap.
+
+    \note Image objects created from OpenGL textures are further restricted by
+    the formats the implementation supports for CL-GL interop.
+ */
+bool QQuickCLContext::isImageFormatSupported(const cl_image_format &format, cl_mem_flags flags) const
+{
+    Q_D(const QQuickCLContext);
+    const cl_mem_flags access = flags & (CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY);
+    for (int i = 0; i < 3; ++i) {
+        if (imageFormatAccess[i] != (access ? access : CL_MEM_READ_WRITE))
+            continue;
+        const QVector<cl_image_format> &formats(d->imageFormats[i]);
+        for (int j = 0; j < formats.count(); ++j) {
+            if (formats[j].image_channel_order == format.image_channel_order
+                    && formats[j].image_channel_data_type == format.image_channel_data_type)
+                return true;
+        }
+    }
+    return false;
+}
+
 QT_END_NAMESPACE
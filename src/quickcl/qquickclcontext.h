@@ -38,7 +38,10 @@
 #define QQUICKCLCONTEXT_H
 
 #include <QtQuickCL/qtquickclglobal.h>
+#include <QtQuickCL/qquickclprogramfuture.h>
+#include <QtQuickCL/qquickcldeviceinfo.h>
 #include <QtGui/qimage.h>
+#include <QtCore/qmap.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -49,13 +52,23 @@ class Q_QUICKCL_EXPORT QQuickCLContext
     Q_DECLARE_PRIVATE(QQuickCLContext)
 
 public:
+    typedef QMap<QByteArray, QByteArray> DefineMap;
+
+    enum SyncMethod {
+        ImplicitSync,
+        ARBCLEventSync,
+        FinishSync
+    };
+
     QQuickCLContext();
     ~QQuickCLContext();
 
     bool create();
+    bool createComputeOnly(cl_device_type deviceType = CL_DEVICE_TYPE_ALL);
     void destroy();
 
     bool isValid() const;
+    bool hasGLInterop() const;
 
     cl_platform_id platform() const;
     cl_device_id device() const;
@@ -63,11 +76,30 @@ public:
 
     QByteArray platformName() const;
     QByteArray deviceExtensions() const;
+    const QQuickCLDeviceInfo &deviceInfo() const;
+
+    SyncMethod syncMethod() const;
+    void syncBeforeAcquire();
+    void syncAfterRelease(cl_command_queue queue, cl_event releaseEvent = 0);
 
     cl_program buildProgram(const QByteArray &src);
+    cl_program buildProgram(const QByteArray &src, const QByteArray &options,
+                            const DefineMap &defines = DefineMap());
     cl_program buildProgramFromFile(const QString &filename);
+    cl_program buildProgramFromFile(const QString &filename, const QByteArray &options,
+                                    const DefineMap &defines = DefineMap());
+    QQuickCLProgramFuture buildProgramAsync(const QByteArray &src, const QByteArray &options = QByteArray(),
+                                            const DefineMap &defines = DefineMap());
+
+    static QByteArray buildOptions(const QByteArray &options, const DefineMap &defines = DefineMap());
+
+    cl_command_queue createCommandQueue(cl_command_queue_properties properties = 0);
 
     static cl_image_format toCLImageFormat(QImage::Format format);
+    bool isImageFormatSupported(const cl_image_format &format, cl_mem_flags flags = CL_MEM_READ_WRITE) const;
+
+    static void setProgramBinaryCacheDirectory(const QString &path);
+    static QString programBinaryCacheDirectory();
 
 private:
     QQuickCLContextPrivate *d_ptr;
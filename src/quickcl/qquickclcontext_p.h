@@ -0,0 +1,145 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLCONTEXT_P_H
+#define QQUICKCLCONTEXT_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qtquickclglobal_p.h"
+#include "qquickclcontext.h"
+#include "qquickcldeviceinfo.h"
+#include <QtCore/QMutex>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QSharedPointer>
+#include <QtGui/qopengl.h>
+
+QT_BEGIN_NAMESPACE
+
+class QOpenGLContext;
+
+class QQuickCLProgramVariants
+{
+public:
+    ~QQuickCLProgramVariants();
+
+    cl_program find(const QByteArray &key);
+    cl_program insert(const QByteArray &key, cl_program prog);
+
+    QMutex mutex;
+    QHash<QByteArray, cl_program> programs;
+};
+
+// Sync objects are resolved at runtime since the GL headers in use may not
+// provide them.
+typedef struct __GLsync *QQuickCLGLsync;
+
+struct QQuickCLSyncFunctions
+{
+    QQuickCLSyncFunctions()
+        : fenceSync(0), clientWaitSync(0), waitSync(0), deleteSync(0), createSyncFromCLevent(0), createEventFromGLsync(0) { }
+
+    QQuickCLGLsync (QOPENGLF_APIENTRYP fenceSync)(GLenum condition, GLbitfield flags);
+    GLenum (QOPENGLF_APIENTRYP clientWaitSync)(QQuickCLGLsync sync, GLbitfield flags, quint64 timeout);
+    void (QOPENGLF_APIENTRYP waitSync)(QQuickCLGLsync sync, GLbitfield flags, quint64 timeout);
+    void (QOPENGLF_APIENTRYP deleteSync)(QQuickCLGLsync sync);
+    QQuickCLGLsync (QOPENGLF_APIENTRYP createSyncFromCLevent)(cl_context context, cl_event event, GLbitfield flags);
+    cl_event (CL_API_CALL *createEventFromGLsync)(cl_context context, QQuickCLGLsync sync, cl_int *errcode_ret);
+};
+
+class Q_QUICKCL_PRIVATE_EXPORT QQuickCLContextPrivate
+{
+public:
+    QQuickCLContextPrivate()
+        : platform(0),
+          device(0),
+          context(0),
+          glInterop(false),
+          syncMethod(QQuickCLContext::ImplicitSync),
+          sharedRef(0),
+          sharedGLContext(0),
+          variants(new QQuickCLProgramVariants)
+    { }
+
+    static QQuickCLContextPrivate *get(QQuickCLContext *c) { return c->d_func(); }
+
+    static QQuickCLContext *acquireShared();
+    static void releaseShared(QQuickCLContext *c);
+
+    bool createComputeOnly(cl_platform_id p, cl_device_id dev);
+    void queryImageFormats();
+    void chooseSyncMethod(QOpenGLContext *ctx);
+    cl_event fenceEvent(QQuickCLGLsync *fence);
+    bool waitForFence();
+    void syncBeforeAcquire();
+    cl_event syncBeforeAcquireOnOtherThread(QQuickCLGLsync *fence);
+    void deleteGLFence(QQuickCLGLsync fence);
+
+    static QByteArray programBinary(cl_program prog);
+    QByteArray programKey(const QByteArray &src, const QByteArray &options) const;
+    cl_program buildProgramFromBinary(const QByteArray &binary, const QByteArray &options) const;
+    void storeProgramBinary(cl_program prog, const QByteArray &key) const;
+    cl_program compileProgram(const QByteArray &src, const QByteArray &options) const;
+    cl_program buildProgram(const QByteArray &src, const QByteArray &options) const;
+
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    bool glInterop;
+    QQuickCLDeviceInfo deviceInfo;
+    QVector<cl_image_format> imageFormats[3]; // read-write, read-only, write-only 2D images
+    QQuickCLContext::SyncMethod syncMethod;
+    QQuickCLSyncFunctions syncFuncs;
+
+    int sharedRef;
+    QOpenGLContext *sharedGLContext;
+
+    QSharedPointer<QQuickCLProgramVariants> variants;
+};
+
+QT_END_NAMESPACE
+
+#endif
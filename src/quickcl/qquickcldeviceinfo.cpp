@@ -0,0 +1,430 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickcldeviceinfo.h"
+#include <QtCore/QList>
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QQuickCLDeviceInfo
+
+    \brief QQuickCLDeviceInfo is a snapshot of the capabilities of an OpenCL
+    device.
+
+    The information is queried once, when the QQuickCLContext is created, and
+    is available via QQuickCLContext::deviceInfo() afterwards. This allows
+    runnables to specialize their kernels and dispatch parameters, for example
+    by choosing a work-group size or a vector width, without repeatedly
+    calling \c clGetDeviceInfo.
+
+    The class is implicitly shared.
+ */
+
+/*!
+    \enum QQuickCLDeviceInfo::Extension
+
+    \value GLSharing \c cl_khr_gl_sharing or \c cl_APPLE_gl_sharing
+    \value GLEvent \c cl_khr_gl_event
+    \value HalfFloat \c cl_khr_fp16
+    \value Double \c cl_khr_fp64
+    \value GlobalInt32BaseAtomics \c cl_khr_global_int32_base_atomics
+    \value LocalInt32BaseAtomics \c cl_khr_local_int32_base_atomics
+    \value ImageWriteSupport3D \c cl_khr_3d_image_writes
+    \value ByteAddressableStore \c cl_khr_byte_addressable_store
+ */
+
+/*!
+    \enum QQuickCLDeviceInfo::VectorType
+
+    \value VectorChar \c char
+    \value VectorShort \c short
+    \value VectorInt \c int
+    \value VectorLong \c long
+    \value VectorFloat \c float
+    \value VectorDouble \c double
+    \value VectorHalf \c half
+ */
+
+class QQuickCLDeviceInfoData : public QSharedData
+{
+public:
+    QQuickCLDeviceInfoData()
+        : type(0),
+          extensions(0),
+          maxWorkGroupSize(0),
+          localMemorySize(0),
+          computeUnits(0),
+          image3DMaxWidth(0),
+          image3DMaxHeight(0),
+          image3DMaxDepth(0),
+          doubleConfig(0),
+          unifiedMemory(false)
+    {
+        for (int i = 0; i < VectorTypeCount; ++i)
+            vectorWidth[i] = 0;
+    }
+
+    enum { VectorTypeCount = QQuickCLDeviceInfo::VectorHalf + 1 };
+
+    QByteArray platformName;
+    QByteArray name;
+    QByteArray vendor;
+    QByteArray driverVersion;
+    QByteArray version;
+    cl_device_type type;
+    QByteArray extensionString;
+    QList<QByteArray> extensionList;
+    QQuickCLDeviceInfo::Extensions extensions;
+    size_t maxWorkGroupSize;
+    cl_ulong localMemorySize;
+    cl_uint computeUnits;
+    QSize image2DMaxSize;
+    size_t image3DMaxWidth;
+    size_t image3DMaxHeight;
+    size_t image3DMaxDepth;
+    cl_uint vectorWidth[VectorTypeCount];
+    cl_device_fp_config doubleConfig;
+    bool unifiedMemory;
+};
+
+/*!
+    Constructs an invalid instance.
+ */
+QQuickCLDeviceInfo::QQuickCLDeviceInfo()
+    : d(new QQuickCLDeviceInfoData)
+{
+}
+
+/*!
+    Constructs a copy of \a other.
+ */
+QQuickCLDeviceInfo::QQuickCLDeviceInfo(const QQuickCLDeviceInfo &other)
+    : d(other.d)
+{
+}
+
+/*!
+    Assigns \a other to this instance.
+ */
+QQuickCLDeviceInfo &QQuickCLDeviceInfo::operator=(const QQuickCLDeviceInfo &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Destroys the instance.
+ */
+QQuickCLDeviceInfo::~QQuickCLDeviceInfo()
+{
+}
+
+static QByteArray platformString(cl_platform_id platform, cl_platform_info param)
+{
+    QByteArray s(1024, '\0');
+    clGetPlatformInfo(platform, param, s.size(), s.data(), 0);
+    s.resize(int(strlen(s.constData())));
+    return s;
+}
+
+static QByteArray deviceString(cl_device_id device, cl_device_info param, int maxSize = 1024)
+{
+    QByteArray s(maxSize, '\0');
+    clGetDeviceInfo(device, param, s.size(), s.data(), 0);
+    s.resize(int(strlen(s.constData())));
+    return s;
+}
+
+template <typename T>
+static T deviceValue(cl_device_id device, cl_device_info param)
+{
+    T v = T();
+    clGetDeviceInfo(device, param, sizeof(T), &v, 0);
+    return v;
+}
+
+/*!
+    Queries the capabilities of \a device belonging to \a platform.
+
+    \note There is normally no need to call this function directly. Use
+    QQuickCLContext::deviceInfo() instead.
+ */
+QQuickCLDeviceInfo QQuickCLDeviceInfo::query(cl_platform_id platform, cl_device_id device)
+{
+    QQuickCLDeviceInfo info;
+    if (!device)
+        return info;
+
+    QQuickCLDeviceInfoData *d = info.d.data();
+    d->platformName = platformString(platform, CL_PLATFORM_NAME);
+    d->name = deviceString(device, CL_DEVICE_NAME);
+    d->vendor = deviceString(device, CL_DEVICE_VENDOR);
+    d->driverVersion = deviceString(device, CL_DRIVER_VERSION);
+    d->version = deviceString(device, CL_DEVICE_VERSION);
+    d->type = deviceValue<cl_device_type>(device, CL_DEVICE_TYPE);
+
+    d->extensionString = deviceString(device, CL_DEVICE_EXTENSIONS, 8192);
+    d->extensionList = d->extensionString.simplified().split(' ');
+    static const struct {
+        const char *name;
+        Extension ext;
+    } knownExtensions[] = {
+        { "cl_khr_gl_sharing", GLSharing },
+        { "cl_APPLE_gl_sharing", GLSharing },
+        { "cl_khr_gl_event", GLEvent },
+        { "cl_khr_fp16", HalfFloat },
+        { "cl_khr_fp64", Double },
+        { "cl_khr_global_int32_base_atomics", GlobalInt32BaseAtomics },
+        { "cl_khr_local_int32_base_atomics", LocalInt32BaseAtomics },
+        { "cl_khr_3d_image_writes", ImageWriteSupport3D },
+        { "cl_khr_byte_addressable_store", ByteAddressableStore }
+    };
+    for (size_t i = 0; i < sizeof(knownExtensions) / sizeof(knownExtensions[0]); ++i) {
+        if (d->extensionList.contains(QByteArray::fromRawData(knownExtensions[i].name,
+                                                              int(strlen(knownExtensions[i].name)))))
+            d->extensions |= knownExtensions[i].ext;
+    }
+
+    d->maxWorkGroupSize = deviceValue<size_t>(device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    d->localMemorySize = deviceValue<cl_ulong>(device, CL_DEVICE_LOCAL_MEM_SIZE);
+    d->computeUnits = deviceValue<cl_uint>(device, CL_DEVICE_MAX_COMPUTE_UNITS);
+    d->image2DMaxSize = QSize(int(deviceValue<size_t>(device, CL_DEVICE_IMAGE2D_MAX_WIDTH)),
+                              int(deviceValue<size_t>(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT)));
+    d->image3DMaxWidth = deviceValue<size_t>(device, CL_DEVICE_IMAGE3D_MAX_WIDTH);
+    d->image3DMaxHeight = deviceValue<size_t>(device, CL_DEVICE_IMAGE3D_MAX_HEIGHT);
+    d->image3DMaxDepth = deviceValue<size_t>(device, CL_DEVICE_IMAGE3D_MAX_DEPTH);
+
+    static const cl_device_info vectorWidthParams[QQuickCLDeviceInfoData::VectorTypeCount] = {
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE,
+        CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF
+    };
+    for (int i = 0; i < QQuickCLDeviceInfoData::VectorTypeCount; ++i)
+        d->vectorWidth[i] = deviceValue<cl_uint>(device, vectorWidthParams[i]);
+
+#ifdef CL_DEVICE_DOUBLE_FP_CONFIG
+    d->doubleConfig = deviceValue<cl_device_fp_config>(device, CL_DEVICE_DOUBLE_FP_CONFIG);
+#endif
+    d->unifiedMemory = deviceValue<cl_bool>(device, CL_DEVICE_HOST_UNIFIED_MEMORY);
+
+    return info;
+}
+
+/*!
+    \return \c true if the instance holds information about a device.
+ */
+bool QQuickCLDeviceInfo::isValid() const
+{
+    return !d->name.isEmpty();
+}
+
+/*!
+    \return the name of the platform the device belongs to.
+ */
+QByteArray QQuickCLDeviceInfo::platformName() const
+{
+    return d->platformName;
+}
+
+/*!
+    \return the device name (\c CL_DEVICE_NAME).
+ */
+QByteArray QQuickCLDeviceInfo::name() const
+{
+    return d->name;
+}
+
+/*!
+    \return the device vendor (\c CL_DEVICE_VENDOR).
+ */
+QByteArray QQuickCLDeviceInfo::vendor() const
+{
+    return d->vendor;
+}
+
+/*!
+    \return the driver version (\c CL_DRIVER_VERSION).
+ */
+QByteArray QQuickCLDeviceInfo::driverVersion() const
+{
+    return d->driverVersion;
+}
+
+/*!
+    \return the OpenCL version supported by the device (\c CL_DEVICE_VERSION).
+ */
+QByteArray QQuickCLDeviceInfo::version() const
+{
+    return d->version;
+}
+
+/*!
+    \return the device type, for example \c CL_DEVICE_TYPE_GPU.
+ */
+cl_device_type QQuickCLDeviceInfo::type() const
+{
+    return d->type;
+}
+
+/*!
+    \return the space separated list of device extensions.
+ */
+QByteArray QQuickCLDeviceInfo::extensionString() const
+{
+    return d->extensionString;
+}
+
+/*!
+    \return the set of well-known extensions supported by the device.
+ */
+QQuickCLDeviceInfo::Extensions QQuickCLDeviceInfo::extensions() const
+{
+    return d->extensions;
+}
+
+/*!
+    \return \c true if \a extension is supported.
+ */
+bool QQuickCLDeviceInfo::hasExtension(Extension extension) const
+{
+    return d->extensions.testFlag(extension);
+}
+
+/*!
+    \return \c true if the extension called \a name is supported.
+ */
+bool QQuickCLDeviceInfo::hasExtension(const QByteArray &name) const
+{
+    return d->extensionList.contains(name);
+}
+
+/*!
+    \return the maximum number of work-items in a work-group.
+ */
+size_t QQuickCLDeviceInfo::maxWorkGroupSize() const
+{
+    return d->maxWorkGroupSize;
+}
+
+/*!
+    \return the size of the local memory arena in bytes.
+ */
+cl_ulong QQuickCLDeviceInfo::localMemorySize() const
+{
+    return d->localMemorySize;
+}
+
+/*!
+    \return the number of parallel compute units.
+ */
+cl_uint QQuickCLDeviceInfo::computeUnits() const
+{
+    return d->computeUnits;
+}
+
+/*!
+    \return the maximum width and height of 2D images.
+ */
+QSize QQuickCLDeviceInfo::image2DMaxSize() const
+{
+    return d->image2DMaxSize;
+}
+
+/*!
+    \return the maximum width of 3D images.
+ */
+size_t QQuickCLDeviceInfo::image3DMaxWidth() const
+{
+    return d->image3DMaxWidth;
+}
+
+/*!
+    \return the maximum height of 3D images.
+ */
+size_t QQuickCLDeviceInfo::image3DMaxHeight() const
+{
+    return d->image3DMaxHeight;
+}
+
+/*!
+    \return the maximum depth of 3D images.
+ */
+size_t QQuickCLDeviceInfo::image3DMaxDepth() const
+{
+    return d->image3DMaxDepth;
+}
+
+/*!
+    \return the preferred native vector width for vectors of \a type.
+ */
+cl_uint QQuickCLDeviceInfo::preferredVectorWidth(VectorType type) const
+{
+    return d->vectorWidth[type];
+}
+
+/*!
+    \return \c true if the device supports half precision floating point
+    arithmetic in kernels.
+ */
+bool QQuickCLDeviceInfo::hasHalfFloat() const
+{
+    return d->extensions.testFlag(HalfFloat);
+}
+
+/*!
+    \return \c true if the device supports double precision floating point
+    arithmetic in kernels.
+ */
+bool QQuickCLDeviceInfo::hasDouble() const
+{
+    return d->extensions.testFlag(Double) || d->doubleConfig != 0;
+}
+
+/*!
+    \return \c true if the device and the host share a unified memory
+    subsystem. Mapping buffers is typically cheap in this case.
+ */
+bool QQuickCLDeviceInfo::hasUnifiedMemory() const
+{
+    return d->unifiedMemory;
+}
+
+QT_END_NAMESPACE
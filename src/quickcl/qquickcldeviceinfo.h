@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLDEVICEINFO_H
+#define QQUICKCLDEVICEINFO_H
+
+#include <QtQuickCL/qtquickclglobal.h>
+#include <QtCore/qshareddata.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qsize.h>
+
+QT_BEGIN_NAMESPACE
+
+class QQuickCLDeviceInfoData;
+
+class Q_QUICKCL_EXPORT QQuickCLDeviceInfo
+{
+public:
+    enum Extension {
+        GLSharing = 0x01,
+        GLEvent = 0x02,
+        HalfFloat = 0x04,
+        Double = 0x08,
+        GlobalInt32BaseAtomics = 0x10,
+        LocalInt32BaseAtomics = 0x20,
+        ImageWriteSupport3D = 0x40,
+        ByteAddressableStore = 0x80
+    };
+    Q_DECLARE_FLAGS(Extensions, Extension)
+
+    enum VectorType {
+        VectorChar,
+        VectorShort,
+        VectorInt,
+        VectorLong,
+        VectorFloat,
+        VectorDouble,
+        VectorHalf
+    };
+
+    QQuickCLDeviceInfo();
+    QQuickCLDeviceInfo(const QQuickCLDeviceInfo &other);
+    QQuickCLDeviceInfo &operator=(const QQuickCLDeviceInfo &other);
+    ~QQuickCLDeviceInfo();
+
+    bool isValid() const;
+
+    QByteArray platformName() const;
+    QByteArray name() const;
+    QByteArray vendor() const;
+    QByteArray driverVersion() const;
+    QByteArray version() const;
+    cl_device_type type() const;
+
+    QByteArray extensionString() const;
+    Extensions extensions() const;
+    bool hasExtension(Extension extension) const;
+    bool hasExtension(const QByteArray &name) const;
+
+    size_t maxWorkGroupSize() const;
+    cl_ulong localMemorySize() const;
+    cl_uint computeUnits() const;
+    QSize image2DMaxSize() const;
+    size_t image3DMaxWidth() const;
+    size_t image3DMaxHeight() const;
+    size_t image3DMaxDepth() const;
+    cl_uint preferredVectorWidth(VectorType type) const;
+    bool hasHalfFloat() const;
+    bool hasDouble() const;
+    bool hasUnifiedMemory() const;
+
+    static QQuickCLDeviceInfo query(cl_platform_id platform, cl_device_id device);
+
+private:
+    QSharedDataPointer<QQuickCLDeviceInfoData> d;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(QQuickCLDeviceInfo::Extensions)
+
+QT_END_NAMESPACE
+
+#endif
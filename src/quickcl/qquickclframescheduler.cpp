@@ -0,0 +1,243 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickclframescheduler_p.h"
+#include "qquickclcontext.h"
+#include <QtQuick/QQuickWindow>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QMutex>
+#include <QtCore/QLoggingCategory>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(logCL)
+
+/*
+    Collects the OpenCL work of all participating items in a window during
+    the synchronization of the scenegraph and submits it in one go once the
+    synchronization is done: one GL-CL synchronization, one acquire for all
+    OpenGL objects, the kernels of every item, one release and one flush. The
+    per-frame synchronization overhead therefore does not grow with the
+    number of items.
+
+    The jobs are submitted from afterSynchronizing(), which is emitted on the
+    render thread while the gui thread is still blocked, so jobs can safely
+    access the state of their items.
+
+    Jobs may read images written by other jobs of the same frame, for example
+    when one item uses the output of another one as its source. Such jobs
+    are enqueued after their producers. The queue is in-order, so the data is
+    passed on without any events, and the shared images are acquired and
+    released only once.
+
+    Items measuring their kernels share a second scheduler for the window,
+    whose queue has profiling enabled.
+ */
+
+struct QQuickCLFrameSchedulerRegistry
+{
+    QMutex mutex;
+    QHash<QPair<QQuickWindow *, bool>, QQuickCLFrameScheduler *> schedulers; // keyed by window and profiling
+};
+
+Q_GLOBAL_STATIC(QQuickCLFrameSchedulerRegistry, schedulerRegistry)
+
+QQuickCLFrameScheduler::QQuickCLFrameScheduler(QQuickWindow *window, QQuickCLContext *clctx, bool profiling)
+    : m_window(window),
+      m_clctx(clctx),
+      // Profiling has a cost on some implementations, only jobs measuring
+      // their kernels for QQuickCLItem::computeBudget ask for it.
+      m_queue(clctx->createCommandQueue(profiling ? CL_QUEUE_PROFILING_ENABLE : 0)),
+      m_profiling(profiling),
+      m_ref(0)
+{
+    connect(window, SIGNAL(afterSynchronizing()), this, SLOT(submit()), Qt::DirectConnection);
+}
+
+QQuickCLFrameScheduler::~QQuickCLFrameScheduler()
+{
+    if (m_queue)
+        clReleaseCommandQueue(m_queue);
+}
+
+/*
+    Returns the scheduler for window, creating it when necessary. When
+    profiling is true, the scheduler's queue has profiling enabled. Must be
+    called on the render thread. Each call must be balanced by a call to
+    release().
+ */
+QQuickCLFrameScheduler *QQuickCLFrameScheduler::acquire(QQuickWindow *window, QQuickCLContext *clctx, bool profiling)
+{
+    QQuickCLFrameSchedulerRegistry *registry = schedulerRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QQuickCLFrameScheduler *s = registry->schedulers.value(qMakePair(window, profiling));
+    if (!s) {
+        s = new QQuickCLFrameScheduler(window, clctx, profiling);
+        if (!s->m_queue) {
+            delete s;
+            return 0;
+        }
+        registry->schedulers.insert(qMakePair(window, profiling), s);
+        qCDebug(logCL, "Created frame scheduler for window %p", window);
+    }
+    ++s->m_ref;
+    return s;
+}
+
+void QQuickCLFrameScheduler::release(QQuickCLFrameScheduler *scheduler)
+{
+    if (!scheduler)
+        return;
+
+    QQuickCLFrameSchedulerRegistry *registry = schedulerRegistry();
+    QMutexLocker lock(&registry->mutex);
+    Q_ASSERT(scheduler->m_ref > 0);
+    if (--scheduler->m_ref > 0)
+        return;
+    registry->schedulers.remove(qMakePair(scheduler->m_window, scheduler->m_profiling));
+    qCDebug(logCL, "Destroying frame scheduler for window %p", scheduler->m_window);
+    lock.unlock();
+    delete scheduler;
+}
+
+/*
+    Queues job for submission in the current frame. Called on the render
+    thread during synchronization.
+ */
+void QQuickCLFrameScheduler::addJob(QQuickCLFrameJob *job)
+{
+    if (!m_jobs.contains(job))
+        m_jobs.append(job);
+}
+
+void QQuickCLFrameScheduler::removeJob(QQuickCLFrameJob *job)
+{
+    m_jobs.removeAll(job);
+}
+
+// Orders the jobs so that the producers of images come before their readers.
+// The order of independent jobs is kept. Cycles are broken by keeping the
+// original order for the jobs involved.
+void QQuickCLFrameScheduler::sortJobs()
+{
+    QVector<QVector<cl_mem> > written;
+    bool anyWritten = false;
+    for (int i = 0; i < m_jobs.count(); ++i) {
+        written.append(m_jobs[i]->writtenObjects());
+        anyWritten |= !written.last().isEmpty();
+    }
+    if (!anyWritten || m_jobs.count() < 2)
+        return;
+
+    QVector<QQuickCLFrameJob *> sorted;
+    QVector<bool> taken(m_jobs.count(), false);
+    while (sorted.count() < m_jobs.count()) {
+        int next = -1;
+        for (int i = 0; i < m_jobs.count() && next < 0; ++i) {
+            if (taken[i])
+                continue;
+            const QVector<cl_mem> objects = m_jobs[i]->glObjects();
+            bool ready = true;
+            for (int j = 0; j < m_jobs.count() && ready; ++j) {
+                if (j == i || taken[j])
+                    continue;
+                for (int k = 0; k < written[j].count() && ready; ++k)
+                    ready = !objects.contains(written[j][k]);
+            }
+            if (ready)
+                next = i;
+        }
+        if (next < 0)
+            next = taken.indexOf(false);
+        taken[next] = true;
+        sorted.append(m_jobs[next]);
+    }
+    m_jobs = sorted;
+}
+
+void QQuickCLFrameScheduler::submit()
+{
+    // render thread, gui thread blocked
+    if (m_jobs.isEmpty())
+        return;
+
+    sortJobs();
+
+    QVector<cl_mem> objects;
+    bool finish = false;
+    for (int i = 0; i < m_jobs.count(); ++i) {
+        const QVector<cl_mem> jobObjects = m_jobs[i]->glObjects();
+        for (int j = 0; j < jobObjects.count(); ++j) {
+            if (!objects.contains(jobObjects[j]))
+                objects.append(jobObjects[j]);
+        }
+        finish |= m_jobs[i]->needsFinish();
+    }
+
+    cl_event releaseEvent = 0;
+    m_clctx->syncBeforeAcquire();
+    cl_int err = clEnqueueAcquireGLObjects(m_queue, objects.count(), objects.constData(), 0, 0, 0);
+    if (err == CL_SUCCESS) {
+        for (int i = 0; i < m_jobs.count(); ++i)
+            m_jobs[i]->enqueue();
+        err = clEnqueueReleaseGLObjects(m_queue, objects.count(), objects.constData(), 0, 0, &releaseEvent);
+        if (err != CL_SUCCESS)
+            qWarning("Failed to queue releasing the GL objects: %d", err);
+    } else {
+        qWarning("Failed to queue acquiring the GL objects: %d", err);
+    }
+
+    if (finish) {
+        clFinish(m_queue);
+    } else {
+        m_clctx->syncAfterRelease(m_queue, releaseEvent);
+        clFlush(m_queue);
+    }
+
+    qCDebug(logCL, "Submitted %d jobs with %d GL objects", m_jobs.count(), objects.count());
+
+    // Jobs may add themselves again for the next frame from submitted().
+    const QVector<QQuickCLFrameJob *> jobs = m_jobs;
+    m_jobs.clear();
+    for (int i = 0; i < jobs.count(); ++i)
+        jobs[i]->submitted(releaseEvent);
+
+    if (releaseEvent)
+        clReleaseEvent(releaseEvent);
+}
+
+QT_END_NAMESPACE
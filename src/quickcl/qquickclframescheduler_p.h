@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLFRAMESCHEDULER_P_H
+#define QQUICKCLFRAMESCHEDULER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtQuickCL/qtquickclglobal.h>
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QQuickWindow;
+class QQuickCLContext;
+
+class QQuickCLFrameJob
+{
+public:
+    virtual ~QQuickCLFrameJob() { }
+
+    // The OpenGL objects to acquire before enqueue() is called.
+    virtual QVector<cl_mem> glObjects() const = 0;
+    // The subset of glObjects() written by enqueue(). Jobs reading them are
+    // enqueued after this one.
+    virtual QVector<cl_mem> writtenObjects() const { return QVector<cl_mem>(); }
+    // Enqueues the OpenCL commands operating on the acquired objects.
+    virtual void enqueue() = 0;
+    // Called after releasing the objects. releaseEvent may be 0 on failure.
+    virtual void submitted(cl_event releaseEvent) = 0;
+    virtual bool needsFinish() const { return false; }
+};
+
+class QQuickCLFrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QQuickCLFrameScheduler *acquire(QQuickWindow *window, QQuickCLContext *clctx, bool profiling);
+    static void release(QQuickCLFrameScheduler *scheduler);
+
+    cl_command_queue commandQueue() const { return m_queue; }
+
+    void addJob(QQuickCLFrameJob *job);
+    void removeJob(QQuickCLFrameJob *job);
+
+private slots:
+    void submit(); // called by QQuickWindow, must be a slot
+
+private:
+    QQuickCLFrameScheduler(QQuickWindow *window, QQuickCLContext *clctx, bool profiling);
+    ~QQuickCLFrameScheduler();
+
+    void sortJobs();
+
+    QQuickWindow *m_window;
+    QQuickCLContext *m_clctx;
+    cl_command_queue m_queue;
+    bool m_profiling;
+    int m_ref;
+    QVector<QQuickCLFrameJob *> m_jobs;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -35,12 +35,22 @@
 ****************************************************************************/
 
 #include "qquickclimagerunnable.h"
-#include "qquickclitem.h"
+#include "qquickclitem_p.h"
 #include "qquickclcontext.h"
+#include "qquickclframescheduler_p.h"
+#include "qquickclcomputethread_p.h"
+#include "qquickclcontext_p.h"
 #include <QSGSimpleTextureNode>
 #include <QSGTextureProvider>
 #include <QOpenGLTexture>
-#include <QOpenGLFunctions>
+#include <QQuickWindow>
+#include <QSharedPointer>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QVarLengthArray>
+#include <QHash>
+#include <QScreen>
+#include <qmath.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -56,7 +66,9 @@ QT_BEGIN_NAMESPACE
     The class provides an OpenCL command queue and a simple texture node for
     the scenegraph. The item providing the texture is read from the associated
     QQuickCLItem's \c source property by default. This can be overridden by
-    calling setSourcePropertyName().
+    calling setSourcePropertyName(). Kernels that combine several images, for
+    example for blending or masking, can read multiple texture providers by
+    calling setSourcePropertyNames() instead.
 
     By using this specialized class instead of the more generic base
     QQuickCLRunnable, applications can focus on the kernels and there is no
@@ -105,83 +117,907 @@ QT_BEGIN_NAMESPACE
     then done by child items since the QQuickCLItem itself does not render
     anything in the Qt Quick scenegraph in this case, although it is still
     present as an item having contents.
+
+    The output of one QQuickCLImageRunnable can be the source of another one,
+    by passing the QQuickCLItem itself, or one of its
+    \l{QQuickCLItem::output()}{outputs}, as the source. When both items use
+    the same command queue, as is the case when both pass \c
+    BatchedSubmission or both pass \c ComputeThread, the downstream item reads
+    the OpenCL image written by the upstream one directly, instead of creating
+    another image for the texture. With \c BatchedSubmission the kernels of
+    the chain run in order within one acquire and release, so the
+    intermediate results do not go through OpenGL synchronization at all.
+    Items on different queues wrap the texture like any other source. The
+    texture providers of the sources are watched, so every new result of the
+    upstream item schedules an update of the downstream one.
+
+    By default each instance synchronizes with OpenGL, acquires its images,
+    runs its kernels and releases the images on its own command queue from
+    update(). When a window contains many such items, passing the \c
+    BatchedSubmission flag makes all participating items in the window share
+    a command queue. Their work is collected during the scenegraph's
+    synchronization and submitted once it is done, with a single
+    synchronization, acquire, release and flush for all of them. runKernel()
+    is then called slightly later, but still on the render thread with the gui
+    thread blocked, so accessing the item's properties remains safe. The flag
+    is ignored when \c Profile is set, since profiling needs a dedicated
+    queue.
+
+    Passing the \c ComputeThread flag moves the submission off the render
+    thread altogether. All such items in a window share a dedicated thread with
+    its own command queue. update() only synchronizes with OpenGL and posts
+    the work, so long running kernels do not stall rendering. runKernel() is
+    then called on the compute thread, while the gui thread may be running, and
+    must therefore not access the item. Values it needs are to be copied in
+    synchronize(), which is called on the render thread with the gui thread
+    blocked. In this mode there is at most one computation per instance in
+    flight, the pipeline depth is at least 2 and the source is shown until the
+    first result is available. The input texture must not be modified by
+    OpenGL while the computation is running. The flag takes precedence over \c
+    BatchedSubmission and is ignored when \c Profile is set. A computation
+    still running when the item releases the runnable is waited for in
+    aboutToBeDeleted(), so subclasses reimplementing that function must call
+    the base class implementation.
+
+    The item's \l{QQuickCLItem::maximumComputeRate}{maximumComputeRate} and
+    \l{QQuickCLItem::computeBudget}{computeBudget} are honored in all modes.
+    When an update arrives too early, the previous output is shown again and
+    another update is scheduled for when the computation is allowed to run.
+    The duration of the kernels is measured with profiling markers around
+    runKernel() and read back without blocking. Command queue profiling is
+    only enabled while it is needed: when the budget is set after the runnable
+    was created, the runnable waits for its pending work once and switches to
+    a queue with profiling enabled.
+
+    For mostly static content, passing the \c SkipUnchanged flag avoids
+    running the kernels when nothing has changed since the previous
+    computation. The source is considered changed when its texture id or size
+    changes, or when updating the texture via QSGDynamicTexture::updateTexture()
+    reports new content, as is the case with layers. When the source is the
+    output of another QQuickCLImageRunnable, every computation of that
+    runnable counts as a change, even when it writes into the same texture.
+    Changes to the parameters of the kernels have to be reported by calling
+    markDirty(), typically from synchronize(). Unchanged updates show the
+    previous output again without acquiring the images or enqueuing any
+    commands.
  */
 
 /*!
-    \fn void QQuickCLImageRunnable::runKernel(cl_mem inImage, cl_mem outImage, const QSize &size)
-
     Called when the OpenCL kernel(s) performing the image processing need to be
     run. \a inImage and \a outImage are ready to be used as input and output
-    \c image2d_t parameters to a kernel. \a size specifies the size of the images.
+    \c image2d_t parameters to a kernel. \a size specifies the size of \a
+    outImage, which is the size of \a inImage unless set otherwise via
+    setOutputSizePolicy(). The size of the input is available from
+    inputSize(). The format of \a outImage is controlled by setOutputFormat().
 
     \note For QQuickCLImageRunnable instances created with the NoImageOutput
     flag \a outImage is always \c 0.
 
-    \note QQuickCLImageRunnable is aware of \c cl_khr_gl_event and will invoke
-    glFinish() and clFinish() as necessary in case the extension is not
-    supported. Both will be omitted when the extension is present. However,
-    clFinish() is still invoked regardless of the presence of the extension when
-    either the \c ForceCLFinish or \c Profile flags are set.
+    \note QQuickCLImageRunnable synchronizes with OpenGL via
+    QQuickCLContext::syncBeforeAcquire() and
+    QQuickCLContext::syncAfterRelease(). No explicit synchronization is done
+    when \c cl_khr_gl_event is supported. However, clFinish() is still invoked
+    regardless of the synchronization method when either the \c ForceCLFinish
+    or \c Profile flags are set.
+
+    \note runKernel() is not called while programs registered via
+    addPendingProgram() are still being built.
+
+    \note With a pipeline depth larger than 1, \a outImage is one of several
+    images the runnable rotates between. Kernels must therefore write every
+    pixel of the output and must not rely on the previous contents.
+
+    Subclasses reimplement either this function or runKernels(). The default
+    implementation warns that neither was reimplemented.
+ */
+void QQuickCLImageRunnable::runKernel(cl_mem inImage, cl_mem outImage, const QSize &size)
+{
+    Q_D(QQuickCLImageRunnable);
+    Q_UNUSED(inImage);
+    Q_UNUSED(outImage);
+    Q_UNUSED(size);
+    if (!d->warnedNoKernel) {
+        qWarning("QQuickCLImageRunnable: neither runKernel() nor runKernels() is reimplemented");
+        d->warnedNoKernel = true;
+    }
+}
+
+/*!
+    Called when the OpenCL kernel(s) need to be run, with all images at once.
+    \a inImages contains one image per source set via
+    setSourcePropertyNames(), in the same order. \a outImages contains one
+    image per output set via setOutputCount(), and is empty when the \c
+    NoOutputImage flag is set. All of them are acquired together. \a size is
+    the size of the outputs.
+
+    The default implementation calls runKernel() with the first image of \a
+    inImages and of \a outImages. Reimplement this function for kernels
+    operating on more than one source or writing more than one output.
  */
+void QQuickCLImageRunnable::runKernels(const QVector<cl_mem> &inImages, const QVector<cl_mem> &outImages,
+                                       const QSize &size)
+{
+    runKernel(inImages.value(0), outImages.value(0), size);
+}
+
+// An output texture and its OpenCL image.
+struct QQuickCLImageTarget
+{
+    QQuickCLImageTarget() : texture(0), sgTexture(0), image(0), format(QOpenGLTexture::NoFormat) { }
+
+    bool matches(const QSize &size, QOpenGLTexture::TextureFormat f) const {
+        return texture && texture->width() == size.width() && texture->height() == size.height() && format == f;
+    }
+
+    QOpenGLTexture *texture;
+    QSGTexture *sgTexture;
+    cl_mem image;
+    QOpenGLTexture::TextureFormat format;
+};
+
+// The output textures written by one runKernel() call. With a pipeline depth
+// of N there are N slots: one is shown, the others are being written by the
+// CL queue.
+struct QQuickCLImageSlot
+{
+    QQuickCLImageSlot() : done(0), serial(0), inFlight(false), pending(false) { }
+
+    QVector<QQuickCLImageTarget> targets;
+    cl_event done;
+    quint64 serial;
+    bool inFlight;
+    bool pending; // posted to the compute thread, done is not known yet
+};
+
+// The output slots are shared between the runnable and the texture node since
+// the node may outlive the runnable, and vice versa. Only used on the render
+// thread, except for handoff() which is called on the compute thread.
+//
+// Outputs that no longer match the source are not destroyed right away but
+// kept in a small pool, keyed by size and format, together with their OpenCL
+// image. When the source goes back to a previous size, for example during a
+// resize animation, the texture is reused and registered with CL only once.
+class QQuickCLImagePipeline
+{
+public:
+    QQuickCLImagePipeline(QQuickCLItem *item, cl_command_queue queue, int depth)
+        : item(item), channel(QQuickCLEventChannel::acquire(item)), renderState(QQuickCLItemRenderState::acquire(item)),
+          queue(queue), outputs(depth), displayed(-1),
+          lastSerial(0), deferred(false), attached(true), targetCount(1), publishedCount(0), publishedSerial(0),
+          handoffSlot(-1), handoffEvent(0)
+    {
+        clRetainCommandQueue(queue);
+    }
+
+    ~QQuickCLImagePipeline()
+    {
+        reset();
+        clReleaseCommandQueue(queue);
+        renderState->deref();
+        channel->deref();
+    }
+
+    void reset();
+    void finish();
+    void setDepth(int depth);
+    void setQueue(cl_command_queue q)
+    {
+        clRetainCommandQueue(q);
+        clReleaseCommandQueue(queue);
+        queue = q;
+    }
+    bool allocate(QQuickCLImageSlot *slot, const QSize &size,
+                  const QVector<QQuickCLImageRunnable::OutputFormat> &formats);
+    bool createTarget(QQuickCLImageTarget *target, const QSize &size, QQuickCLImageRunnable::OutputFormat format);
+    void recycle(QQuickCLImageSlot *slot);
+    void recycleTarget(QQuickCLImageTarget *target);
+    int freeSlot() const;
+    bool poll();
+    void watch(QQuickCLImageSlot *slot);
+    void handoff(int slot, cl_event event);
+    void publish();
+
+    QSGTexture *displayedTexture(int index = 0) const {
+        return displayed >= 0 && index < outputs[displayed].targets.count() ? outputs[displayed].targets[index].sgTexture : 0;
+    }
+
+    QQuickCLItem *item; // only used while the gui thread is blocked
+    QQuickCLEventChannel *channel; // for notifications from other threads or while rendering
+    QQuickCLItemRenderState *renderState; // the item's texture providers, render thread only
+    cl_command_queue queue;
+    QVector<QQuickCLImageSlot> outputs;
+    QVector<QQuickCLImageTarget> pool; // least recently used first
+    int displayed;
+    quint64 lastSerial;
+    bool deferred;
+    bool attached; // false once the runnable is gone, the item may be gone as well
+    int targetCount;
+    int publishedCount;
+    quint64 publishedSerial; // of the displayed slot when last published
+
+    QMutex handoffMutex;
+    int handoffSlot;
+    cl_event handoffEvent;
+};
+
+static const int MAX_POOLED_OUTPUTS = 4;
+
+// The output images of all runnables, keyed by the scenegraph texture for
+// them. A runnable whose source is the output of another one uses the image
+// directly instead of wrapping the texture again, but only when both use the
+// same in-order command queue, as is the case with BatchedSubmission. On
+// different queues nothing would order the reads after the writes. The
+// serial is bumped whenever the producer writes the image, since with a
+// pipeline depth of 1 the texture stays the same while its content changes.
+// Used from the render threads of all windows.
+struct QQuickCLSharedImage
+{
+    cl_context context;
+    cl_mem image;
+    cl_command_queue queue; // of the last write
+    quint64 serial;
+};
+
+struct QQuickCLImageRegistry
+{
+    QMutex mutex;
+    QHash<QSGTexture *, QQuickCLSharedImage> images;
+};
+
+Q_GLOBAL_STATIC(QQuickCLImageRegistry, imageRegistry)
+
+static void registerImage(QSGTexture *texture, cl_context context, cl_mem image, cl_command_queue queue)
+{
+    QQuickCLImageRegistry *registry = imageRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QQuickCLSharedImage entry = { context, image, queue, 1 };
+    registry->images.insert(texture, entry);
+}
+
+static void unregisterImage(QSGTexture *texture)
+{
+    QQuickCLImageRegistry *registry = imageRegistry();
+    QMutexLocker lock(&registry->mutex);
+    registry->images.remove(texture);
+}
+
+// Records that the image for texture gets new content, written on queue.
+static void touchImage(QSGTexture *texture, cl_command_queue queue)
+{
+    QQuickCLImageRegistry *registry = imageRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QHash<QSGTexture *, QQuickCLSharedImage>::iterator it = registry->images.find(texture);
+    if (it != registry->images.end()) {
+        it->queue = queue;
+        ++it->serial;
+    }
+}
+
+// Returns the serial of the content of texture, or 0 when texture is not the
+// output of a runnable.
+static quint64 imageSerial(QSGTexture *texture)
+{
+    QQuickCLImageRegistry *registry = imageRegistry();
+    QMutexLocker lock(&registry->mutex);
+    return registry->images.value(texture).serial;
+}
+
+// Returns the image written by another runnable for texture, retained, or 0
+// when texture is not such an output in context or is written on a queue
+// other than queue.
+static cl_mem sharedImage(QSGTexture *texture, cl_context context, cl_command_queue queue)
+{
+    QQuickCLImageRegistry *registry = imageRegistry();
+    QMutexLocker lock(&registry->mutex);
+    QHash<QSGTexture *, QQuickCLSharedImage>::const_iterator it = registry->images.constFind(texture);
+    if (it == registry->images.constEnd() || it->context != context || it->queue != queue)
+        return 0;
+    clRetainMemObject(it->image);
+    return it->image;
+}
+
+struct QQuickCLOutputFormatInfo
+{
+    QOpenGLTexture::TextureFormat textureFormat;
+    QOpenGLTexture::PixelFormat pixelFormat; // only used when immutable storage is not available
+    QOpenGLTexture::PixelType pixelType;
+    cl_channel_order channelOrder;
+    cl_channel_type channelType;
+};
+
+// Indexed by QQuickCLImageRunnable::OutputFormat
+static const QQuickCLOutputFormatInfo outputFormatTable[] = {
+    { QOpenGLTexture::RGBA8_UNorm, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, CL_RGBA, CL_UNORM_INT8 },
+    { QOpenGLTexture::R8_UNorm, QOpenGLTexture::Red, QOpenGLTexture::UInt8, CL_R, CL_UNORM_INT8 },
+    { QOpenGLTexture::RG8_UNorm, QOpenGLTexture::RG, QOpenGLTexture::UInt8, CL_RG, CL_UNORM_INT8 },
+    { QOpenGLTexture::RGBA16F, QOpenGLTexture::RGBA, QOpenGLTexture::Float16, CL_RGBA, CL_HALF_FLOAT },
+    { QOpenGLTexture::RGBA32F, QOpenGLTexture::RGBA, QOpenGLTexture::Float32, CL_RGBA, CL_FLOAT },
+    { QOpenGLTexture::R32F, QOpenGLTexture::Red, QOpenGLTexture::Float32, CL_R, CL_FLOAT }
+};
+
+static void releaseTarget(QQuickCLImageTarget *target)
+{
+    if (target->sgTexture)
+        unregisterImage(target->sgTexture);
+    if (target->image)
+        clReleaseMemObject(target->image);
+    delete target->sgTexture;
+    delete target->texture;
+    *target = QQuickCLImageTarget();
+}
+
+static void releaseSlot(QQuickCLImageSlot *slot)
+{
+    if (slot->done)
+        clReleaseEvent(slot->done);
+    for (int i = 0; i < slot->targets.count(); ++i)
+        releaseTarget(&slot->targets[i]);
+    *slot = QQuickCLImageSlot();
+}
+
+void QQuickCLImagePipeline::reset()
+{
+    finish();
+    for (int i = 0; i < outputs.count(); ++i)
+        releaseSlot(&outputs[i]);
+    for (int i = 0; i < pool.count(); ++i)
+        releaseTarget(&pool[i]);
+    pool.clear();
+    displayed = -1;
+    deferred = false;
+}
+
+// Waits for the outputs that are still being written. Results of compute
+// thread jobs that were cancelled before running are dropped. Must not be
+// called while a job for the pipeline is queued or running.
+void QQuickCLImagePipeline::finish()
+{
+    {
+        QMutexLocker lock(&handoffMutex);
+        if (handoffSlot >= 0) {
+            outputs[handoffSlot].pending = false;
+            outputs[handoffSlot].done = handoffEvent;
+        }
+        handoffSlot = -1;
+        handoffEvent = 0;
+    }
+
+    bool busy = false;
+    for (int i = 0; i < outputs.count(); ++i) {
+        QQuickCLImageSlot &slot(outputs[i]);
+        if (slot.pending) {
+            slot.pending = false;
+            slot.inFlight = false;
+            slot.serial = 0;
+        }
+        busy |= slot.inFlight;
+    }
+    if (busy)
+        clFinish(queue);
+
+    for (int i = 0; i < outputs.count(); ++i) {
+        QQuickCLImageSlot &slot(outputs[i]);
+        if (slot.done) {
+            clReleaseEvent(slot.done);
+            slot.done = 0;
+        }
+        slot.inFlight = false;
+    }
+}
+
+// Changes the number of slots. The existing outputs go to the pool.
+void QQuickCLImagePipeline::setDepth(int depth)
+{
+    finish();
+    for (int i = 0; i < outputs.count(); ++i)
+        recycle(&outputs[i]);
+    outputs = QVector<QQuickCLImageSlot>(depth);
+    displayed = -1;
+}
+
+// Moves the textures and images of slot, which must not be in flight, to the pool.
+void QQuickCLImagePipeline::recycle(QQuickCLImageSlot *slot)
+{
+    Q_ASSERT(!slot->inFlight);
+    if (displayed >= 0 && slot == &outputs[displayed])
+        displayed = -1;
+    if (slot->done)
+        clReleaseEvent(slot->done);
+    for (int i = 0; i < slot->targets.count(); ++i)
+        recycleTarget(&slot->targets[i]);
+    *slot = QQuickCLImageSlot();
+}
+
+void QQuickCLImagePipeline::recycleTarget(QQuickCLImageTarget *target)
+{
+    if (target->texture) {
+        pool.append(*target);
+        // Enough for a few sizes of every output of every slot.
+        if (pool.count() > MAX_POOLED_OUTPUTS * qMax(1, outputs.value(0).targets.count())) {
+            releaseTarget(&pool.first());
+            pool.removeFirst();
+        }
+    }
+    *target = QQuickCLImageTarget();
+}
+
+// Makes sure slot has textures and images of the given size and formats,
+// either the ones it already has, pooled ones or newly created ones.
+bool QQuickCLImagePipeline::allocate(QQuickCLImageSlot *slot, const QSize &size,
+                                     const QVector<QQuickCLImageRunnable::OutputFormat> &formats)
+{
+    if (slot->targets.count() != formats.count()) {
+        recycle(slot);
+        slot->targets.resize(formats.count());
+    }
+
+    for (int i = 0; i < formats.count(); ++i) {
+        QQuickCLImageTarget *target = &slot->targets[i];
+        const QOpenGLTexture::TextureFormat format = outputFormatTable[formats[i]].textureFormat;
+        if (target->matches(size, format))
+            continue;
+        // The slot's contents are no longer complete.
+        if (displayed >= 0 && slot == &outputs[displayed])
+            displayed = -1;
+        slot->serial = 0;
+        recycleTarget(target);
+
+        for (int j = pool.count() - 1; j >= 0; --j) {
+            if (pool[j].matches(size, format)) {
+                *target = pool[j];
+                pool.remove(j);
+                break;
+            }
+        }
+        if (!target->texture && !createTarget(target, size, formats[i]))
+            return false;
+    }
+    return true;
+}
+
+bool QQuickCLImagePipeline::createTarget(QQuickCLImageTarget *target, const QSize &size,
+                                         QQuickCLImageRunnable::OutputFormat outputFormat)
+{
+    const QQuickCLOutputFormatInfo &info(outputFormatTable[outputFormat]);
 
-class QQuickCLImageRunnablePrivate
+    // Only GPU storage is needed, the kernels write every pixel. This uses
+    // immutable storage (glTexStorage2D) when supported.
+    target->texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    target->texture->setFormat(info.textureFormat);
+    target->texture->setSize(size.width(), size.height());
+    target->texture->setMipLevels(1);
+    target->texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    target->texture->allocateStorage(info.pixelFormat, info.pixelType);
+    if (!target->texture->isStorageAllocated()) {
+        qWarning("Failed to allocate storage for output OpenGL texture");
+        releaseTarget(target);
+        return false;
+    }
+    // Show single channel outputs as grayscale instead of red.
+    if (info.channelOrder == CL_R && target->texture->hasFeature(QOpenGLTexture::Swizzle))
+        target->texture->setSwizzleMask(QOpenGLTexture::RedValue, QOpenGLTexture::RedValue,
+                                        QOpenGLTexture::RedValue, QOpenGLTexture::OneValue);
+    target->format = info.textureFormat;
+    cl_int err = 0;
+    // Readable as well, for runnables using the output as their source.
+    target->image = clCreateFromGLTexture2D(item->context()->context(), CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0,
+                                            target->texture->textureId(), &err);
+    if (!target->image) {
+        qWarning("Failed to create OpenCL image object for output OpenGL texture: %d", err);
+        releaseTarget(target);
+        return false;
+    }
+    target->sgTexture = item->window()->createTextureFromId(target->texture->textureId(), size);
+    registerImage(target->sgTexture, item->context()->context(), target->image, queue);
+    return true;
+}
+
+// Exposes the displayed outputs via the item's texture providers. Every new
+// result is signaled, also when it was written to the same texture as the
+// previous one, so that items using the outputs as their source update.
+void QQuickCLImagePipeline::publish()
+{
+    if (!attached)
+        return;
+    const quint64 serial = displayed >= 0 ? outputs[displayed].serial : 0;
+    const bool contentChanged = serial != publishedSerial;
+    publishedSerial = serial;
+    for (int i = 0; i < qMax(targetCount, publishedCount); ++i)
+        renderState->setOutputTexture(i < targetCount ? displayedTexture(i) : 0, i, contentChanged);
+    publishedCount = targetCount;
+}
+
+// Passes the release event for slot from the compute thread to the render thread.
+void QQuickCLImagePipeline::handoff(int slot, cl_event event)
+{
+    QMutexLocker lock(&handoffMutex);
+    handoffSlot = slot;
+    handoffEvent = event;
+}
+
+int QQuickCLImagePipeline::freeSlot() const
+{
+    // Without pipelining the only output is reused, just like before.
+    if (outputs.count() == 1)
+        return 0;
+    for (int i = 0; i < outputs.count(); ++i) {
+        if (i != displayed && !outputs[i].inFlight)
+            return i;
+    }
+    return -1;
+}
+
+// Picks up completed outputs without blocking and switches to the newest
+// finished one. Returns true when the displayed slot changed.
+bool QQuickCLImagePipeline::poll()
+{
+    {
+        QMutexLocker lock(&handoffMutex);
+        if (handoffSlot >= 0) {
+            QQuickCLImageSlot &slot(outputs[handoffSlot]);
+            slot.pending = false;
+            slot.done = handoffEvent;
+            if (slot.done)
+                watch(&slot);
+            handoffSlot = -1;
+            handoffEvent = 0;
+        }
+    }
+
+    for (int i = 0; i < outputs.count(); ++i) {
+        QQuickCLImageSlot &slot(outputs[i]);
+        if (!slot.inFlight || slot.pending)
+            continue;
+        if (slot.done) {
+            cl_int status = CL_QUEUED;
+            clGetEventInfo(slot.done, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+            if (status > CL_COMPLETE) // still queued, submitted or running; negative values are errors
+                continue;
+            clReleaseEvent(slot.done);
+            slot.done = 0;
+        }
+        slot.inFlight = false;
+    }
+
+    int newest = displayed;
+    for (int i = 0; i < outputs.count(); ++i) {
+        if (!outputs[i].inFlight && outputs[i].serial && (newest < 0 || outputs[i].serial > outputs[newest].serial))
+            newest = i;
+    }
+    const bool changed = newest != displayed;
+    displayed = newest;
+
+    // A dispatch was skipped because all outputs were busy. Now that one is
+    // free, have the item call update() again. This may run while rendering,
+    // with the gui thread active, so the item is reached via the channel.
+    if (deferred && freeSlot() >= 0) {
+        deferred = false;
+        if (attached)
+            channel->scheduleUpdate();
+    }
+
+    return changed;
+}
+
+static void CL_CALLBACK slotDoneCallback(cl_event, cl_int, void *user_data)
+{
+    // Any thread. Request a new frame so the node can pick up the results in
+    // preprocess(). Unlike QQuickCLItem::scheduleUpdate() this does not lead
+    // to running the kernels again.
+    QQuickCLEventChannel *channel = static_cast<QQuickCLEventChannel *>(user_data);
+    channel->scheduleWindowUpdate();
+    channel->deref();
+}
+
+void QQuickCLImagePipeline::watch(QQuickCLImageSlot *slot)
+{
+    channel->ref.ref(); // released by the callback
+    cl_int err = clSetEventCallback(slot->done, CL_COMPLETE, slotDoneCallback, channel);
+    if (err != CL_SUCCESS) {
+        qWarning("Failed to set event callback: %d", err);
+        channel->deref();
+    }
+}
+
+class QQuickCLImageNode : public QSGSimpleTextureNode
 {
 public:
-    QQuickCLImageRunnablePrivate(QQuickCLItem *item, QQuickCLImageRunnable::Flags flags)
-        : item(item),
+    QQuickCLImageNode(const QSharedPointer<QQuickCLImagePipeline> &pipeline)
+        : pipeline(pipeline)
+    {
+        setFiltering(QSGTexture::Linear);
+    }
+
+    void preprocess() Q_DECL_OVERRIDE
+    {
+        if (pipeline->poll()) {
+            setTexture(pipeline->displayedTexture());
+            pipeline->publish();
+        }
+    }
+
+    QSharedPointer<QQuickCLImagePipeline> pipeline;
+};
+
+// A texture provider read from a property of the item, with the OpenCL image
+// wrapping its texture.
+struct QQuickCLImageSource
+{
+    QQuickCLImageSource(const QByteArray &propertyName = QByteArray())
+        : propertyName(propertyName), textureId(0), serial(0), image(0), shared(false) { }
+
+    QByteArray propertyName;
+    uint textureId;
+    QSize size;
+    quint64 serial; // of the content when the source is the output of another runnable
+    cl_mem image;
+    bool shared; // image is the output of another runnable
+    QPointer<QSGTextureProvider> provider; // connected to the runnable's source watcher
+};
+
+class QQuickCLImageRunnablePrivate : public QQuickCLFrameJob, public QQuickCLComputeJob
+{
+    Q_DECLARE_PUBLIC(QQuickCLImageRunnable)
+
+public:
+    QQuickCLImageRunnablePrivate(QQuickCLImageRunnable *q, QQuickCLItem *item, QQuickCLImageRunnable::Flags flags)
+        : q_ptr(q),
+          item(item),
+          clctx(item->context()),
+          channel(QQuickCLEventChannel::acquire(item)),
+          sourceWatcher(channel),
           flags(flags),
           queue(0),
-          inputTexture(0),
-          outputTexture(0),
-          elapsed(0)
+          queueProfiling(false),
+          scheduler(0),
+          computeThread(0),
+          computeWait(0),
+          acquireFence(0),
+          computeSlot(-1),
+          outputFormats(1, QQuickCLImageRunnable::RGBA8),
+          outputSizePolicy(QQuickCLImageRunnable::SourceSize),
+          outputScale(1),
+          pipelineDepth(1),
+          slot(0),
+          elapsed(0),
+          kernelTime(0),
+          measureKernelTime(false),
+          lastCompute(-1),
+          sourceGeneration(1),
+          computedGeneration(0),
+          parametersDirty(false),
+          passthroughNode(false),
+          warnedNoKernel(false)
     {
-        image[0] = image[1] = 0;
         profEv[0] = profEv[1] = 0;
-        sourcePropertyName = QByteArrayLiteral("source");
+        budgetEv[0] = budgetEv[1] = 0;
+        clock.start();
+        sources.append(QQuickCLImageSource(QByteArrayLiteral("source")));
     }
 
     ~QQuickCLImageRunnablePrivate() {
-        if (image[0])
-            clReleaseMemObject(image[0]);
-        if (image[1])
-            clReleaseMemObject(image[1]);
-        if (queue)
-            clReleaseCommandQueue(queue);
-        delete outputTexture;
+        releaseQueue(); // the compute job is normally already cancelled in aboutToBeDeleted()
+        QQuickCLContextPrivate::get(clctx)->deleteGLFence(acquireFence);
+        for (int i = 0; i < 2; ++i) {
+            if (budgetEv[i])
+                clReleaseEvent(budgetEv[i]);
+        }
+        for (int i = 0; i < sources.count(); ++i) {
+            if (sources[i].image)
+                clReleaseMemObject(sources[i].image);
+        }
+        if (pipeline)
+            pipeline->attached = false;
+        pipeline.clear();
+        channel->deref();
     }
 
+    QVector<cl_mem> glObjects() const Q_DECL_OVERRIDE;
+    QVector<cl_mem> writtenObjects() const Q_DECL_OVERRIDE;
+    void enqueue() Q_DECL_OVERRIDE;
+    void submitted(cl_event releaseEvent) Q_DECL_OVERRIDE;
+    bool needsFinish() const Q_DECL_OVERRIDE;
+
+    void run(cl_command_queue computeQueue) Q_DECL_OVERRIDE;
+    void done() Q_DECL_OVERRIDE;
+
+    int effectivePipelineDepth() const { return computeThread ? qMax(2, pipelineDepth) : pipelineDepth; }
+
+    void acquireQueue(bool profiling);
+    void releaseQueue();
+    void enableProfiling();
+
+    QQuickCLImageRunnable *q_ptr;
     QQuickCLItem *item;
+    QQuickCLContext *clctx;
+    QQuickCLEventChannel *channel; // for notifying the item from the compute thread
+    QQuickCLSourceWatcher sourceWatcher;
     QQuickCLImageRunnable::Flags flags;
     cl_command_queue queue;
-    cl_mem image[2];
-    QSize textureSize;
-    uint inputTexture;
-    QOpenGLTexture *outputTexture;
-    QByteArray sourcePropertyName;
+    bool queueProfiling;
+    QQuickCLFrameScheduler *scheduler;
+    QQuickCLComputeThread *computeThread;
+    cl_event computeWait;
+    QQuickCLGLsync acquireFence; // for computeWait, deleted once the next job has been enqueued
+    int computeSlot;
+    QAtomicInt computeDeferred;
+    QVector<QQuickCLImageSource> sources;
+    QVector<cl_mem> inputImages;
+    QVector<cl_mem> outputImages;
+    QVector<cl_mem> images; // the inputs and the outputs, acquired together
+    QVector<QQuickCLImageRunnable::OutputFormat> outputFormats;
+    QQuickCLImageRunnable::OutputSizePolicy outputSizePolicy;
+    QSize fixedOutputSize;
+    qreal outputScale;
+    QSize outputSize;
+    int pipelineDepth;
+    QSharedPointer<QQuickCLImagePipeline> pipeline;
+    QQuickCLImageSlot *slot;
     cl_event profEv[2];
     double elapsed;
-    bool needsExplicitSync;
+    cl_event budgetEv[2];
+    double kernelTime;
+    bool measureKernelTime;
+    QElapsedTimer clock;
+    qint64 lastCompute;
+    quint64 sourceGeneration;
+    quint64 computedGeneration;
+    bool parametersDirty;
+    QVector<QQuickCLProgramFuture> pendingPrograms;
+    bool passthroughNode;
+    bool warnedNoKernel;
+
+    QSGNode *updateOutputNode(QSGNode *node, QSGTexture *placeholder = 0);
+    void watchSource(int index, QSGTextureProvider *provider);
+    QSize requestedOutputSize(const QSize &sourceSize) const;
+    void cancelComputeJob();
+    void collectKernelTime();
+    int throttle();
 };
 
+// Picks up the duration of the last measured computation without blocking.
+void QQuickCLImageRunnablePrivate::collectKernelTime()
+{
+    if (flags.testFlag(QQuickCLImageRunnable::Profile)) {
+        kernelTime = elapsed;
+        return;
+    }
+    if (!budgetEv[1])
+        return;
+    cl_int status = CL_QUEUED;
+    clGetEventInfo(budgetEv[1], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+    if (status > CL_COMPLETE)
+        return;
+    cl_ulong start = 0, end = 0;
+    // Markers complete when the preceding commands do, so this is the time spent on runKernel()'s commands.
+    if (clGetEventProfilingInfo(budgetEv[0], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &start, 0) == CL_SUCCESS
+            && clGetEventProfilingInfo(budgetEv[1], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, 0) == CL_SUCCESS
+            && end > start)
+        kernelTime = double(end - start) / 1000000.0;
+    clReleaseEvent(budgetEv[0]);
+    clReleaseEvent(budgetEv[1]);
+    budgetEv[0] = budgetEv[1] = 0;
+}
+
+// Returns the number of milliseconds until the next computation is allowed
+// by the item's maximumComputeRate and computeBudget, 0 if it can run now.
+int QQuickCLImageRunnablePrivate::throttle()
+{
+    const qreal rate = item->maximumComputeRate();
+    const qreal budget = item->computeBudget();
+    if (rate <= 0 && budget <= 0)
+        return 0;
+
+    collectKernelTime();
+    if (lastCompute < 0)
+        return 0;
+
+    qreal interval = rate > 0 ? 1000 / rate : 0;
+    if (budget > 0 && kernelTime > budget) {
+        // Spread the GPU time over as many frames as needed to stay within the budget on average.
+        const qreal refreshRate = item->window() && item->window()->screen() ? item->window()->screen()->refreshRate() : 0;
+        const qreal frameTime = 1000 / (refreshRate > 0 ? refreshRate : 60);
+        interval = qMax(interval, kernelTime / budget * frameTime);
+    }
+    const qint64 remaining = lastCompute + qCeil(interval) - clock.elapsed();
+    return remaining > 0 ? int(remaining) : 0;
+}
+
+// Waits for the job on the compute thread, or removes it when it has not started yet.
+void QQuickCLImageRunnablePrivate::cancelComputeJob()
+{
+    if (!computeThread)
+        return;
+    computeThread->cancel(this);
+    // A job removed from the queue before running leaves its wait event behind.
+    if (computeWait)
+        clReleaseEvent(computeWait);
+    computeWait = 0;
+    computeSlot = -1;
+}
+
+QSize QQuickCLImageRunnablePrivate::requestedOutputSize(const QSize &sourceSize) const
+{
+    QSize size;
+    switch (outputSizePolicy) {
+    case QQuickCLImageRunnable::FixedSize:
+        size = fixedOutputSize;
+        break;
+    case QQuickCLImageRunnable::ScaledSourceSize:
+        size = QSize(qRound(sourceSize.width() * outputScale), qRound(sourceSize.height() * outputScale));
+        break;
+    case QQuickCLImageRunnable::ItemPixelSize:
+    {
+        const qreal dpr = item->window() ? item->window()->effectiveDevicePixelRatio() : 1;
+        size = QSize(qCeil(item->width() * dpr), qCeil(item->height() * dpr));
+        break;
+    }
+    default:
+        size = sourceSize;
+        break;
+    }
+    size = size.expandedTo(QSize(1, 1));
+    const QSize maxSize = clctx->deviceInfo().image2DMaxSize();
+    if (!maxSize.isEmpty())
+        size = size.boundedTo(maxSize);
+    return size;
+}
+
+// Updates the item whenever the texture provider of the source at index
+// changes its texture or, for outputs of other runnables, its content.
+void QQuickCLImageRunnablePrivate::watchSource(int index, QSGTextureProvider *provider)
+{
+    QQuickCLImageSource &src(sources[index]);
+    if (src.provider == provider)
+        return;
+    if (src.provider) {
+        bool used = false;
+        for (int i = 0; i < sources.count(); ++i)
+            used |= i != index && sources[i].provider == src.provider;
+        if (!used)
+            QObject::disconnect(src.provider, SIGNAL(textureChanged()), &sourceWatcher, SLOT(sourceChanged()));
+    }
+    src.provider = provider;
+    if (provider)
+        QObject::connect(provider, SIGNAL(textureChanged()), &sourceWatcher, SLOT(sourceChanged()),
+                         Qt::ConnectionType(Qt::DirectConnection | Qt::UniqueConnection));
+}
+
+QSGNode *QQuickCLImageRunnablePrivate::updateOutputNode(QSGNode *node, QSGTexture *placeholder)
+{
+    pipeline->targetCount = outputFormats.count();
+    pipeline->publish();
+    QSGTexture *texture = pipeline->displayedTexture();
+    if (!texture)
+        texture = placeholder;
+    if (!texture) {
+        delete node;
+        return 0;
+    }
+    QQuickCLImageNode *tnode = static_cast<QQuickCLImageNode *>(node);
+    if (!tnode)
+        tnode = new QQuickCLImageNode(pipeline);
+    tnode->setFlag(QSGNode::UsePreprocess, pipeline->outputs.count() > 1);
+    tnode->setTexture(texture);
+    tnode->setRect(item->boundingRect());
+    tnode->markDirty(QSGNode::DirtyMaterial);
+    return tnode;
+}
+
 /*!
     Constructs a new QQuickCLImageRunnable instance associated with \a item.
     Special behavior, for example computations producing arbitrary non-image
     output, can be enabled via \a flags.
  */
 QQuickCLImageRunnable::QQuickCLImageRunnable(QQuickCLItem *item, Flags flags)
-    : d_ptr(new QQuickCLImageRunnablePrivate(item, flags))
+    : d_ptr(new QQuickCLImageRunnablePrivate(this, item, flags))
 {
     Q_D(QQuickCLImageRunnable);
-    cl_int err;
-    cl_command_queue_properties queueProps = flags.testFlag(Profile) ? CL_QUEUE_PROFILING_ENABLE : 0;
     QQuickCLContext *clctx = item->context();
     Q_ASSERT(clctx);
-    d->queue = clCreateCommandQueue(clctx->context(), clctx->device(), queueProps, &err);
-    if (!d->queue) {
-        qWarning("Failed to create OpenCL command queue: %d", err);
-        return;
-    }
-    d->needsExplicitSync = !clctx->deviceExtensions().contains(QByteArrayLiteral("cl_khr_gl_event"));
+    if (!clctx->hasGLInterop())
+        qWarning("QQuickCLImageRunnable requires an OpenCL context with CL-GL interop");
+    d->acquireQueue(flags.testFlag(Profile) || item->computeBudget() > 0);
 }
 
 QQuickCLImageRunnable::~QQuickCLImageRunnable()
@@ -189,8 +1025,68 @@ QQuickCLImageRunnable::~QQuickCLImageRunnable()
     delete d_ptr;
 }
 
+// Profiling has a cost on some implementations, so the queue has it enabled
+// only for the Profile flag or when the kernels are measured for the item's
+// computeBudget.
+void QQuickCLImageRunnablePrivate::acquireQueue(bool profiling)
+{
+    queueProfiling = profiling;
+    if (flags.testFlag(QQuickCLImageRunnable::ComputeThread) && !flags.testFlag(QQuickCLImageRunnable::Profile)) {
+        computeThread = QQuickCLComputeThread::acquire(item->window(), clctx, profiling);
+        if (computeThread) {
+            queue = computeThread->commandQueue();
+            clRetainCommandQueue(queue);
+            return;
+        }
+    }
+    if (flags.testFlag(QQuickCLImageRunnable::BatchedSubmission) && !flags.testFlag(QQuickCLImageRunnable::Profile)) {
+        scheduler = QQuickCLFrameScheduler::acquire(item->window(), clctx, profiling);
+        if (scheduler) {
+            queue = scheduler->commandQueue();
+            clRetainCommandQueue(queue);
+            return;
+        }
+    }
+    queue = clctx->createCommandQueue(profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+}
+
+void QQuickCLImageRunnablePrivate::releaseQueue()
+{
+    if (scheduler) {
+        scheduler->removeJob(this);
+        QQuickCLFrameScheduler::release(scheduler);
+        scheduler = 0;
+    }
+    if (computeThread) {
+        cancelComputeJob();
+        QQuickCLComputeThread::release(computeThread);
+        computeThread = 0;
+    }
+    if (queue) {
+        clReleaseCommandQueue(queue);
+        queue = 0;
+    }
+}
+
+// Switches to a queue with profiling enabled when the item's computeBudget
+// is set after the runnable was created. Everything submitted so far is
+// waited for, since the images must not be acquired by two queues at once.
+void QQuickCLImageRunnablePrivate::enableProfiling()
+{
+    cancelComputeJob();
+    if (queue)
+        clFinish(queue);
+    releaseQueue();
+    acquireQueue(true);
+    if (pipeline)
+        pipeline->setQueue(queue);
+}
+
 /*!
     \return the OpenCL command queue.
+
+    \note With the \c ComputeThread flag this is the queue of the compute
+    thread, which is shared by all such items in the window.
  */
 cl_command_queue QQuickCLImageRunnable::commandQueue() const
 {
@@ -201,132 +1097,761 @@ cl_command_queue QQuickCLImageRunnable::commandQueue() const
 /*!
     Sets the name of the property that is queried from the item that was passed
     to the constructor. The default value is \c source.
+
+    \sa setSourcePropertyNames()
  */
 void QQuickCLImageRunnable::setSourcePropertyName(const QByteArray &name)
+{
+    setSourcePropertyNames(QList<QByteArray>() << name);
+}
+
+/*!
+    Sets the names of the properties that are queried from the item that was
+    passed to the constructor to \a names. Each property must refer to a
+    texture provider.
+
+    This allows kernels operating on several images at once, for example for
+    blending, compositing or masking, without chaining multiple items. Each
+    source gets its own OpenCL image, and all of them, together with the
+    output, are acquired and released with a single call. The images are
+    passed to runKernels(), in the order of \a names.
+
+    \code
+        CLRunnable(QQuickCLItem *item)
+            : QQuickCLImageRunnable(item)
+        {
+            setSourcePropertyNames(QList<QByteArray>() << "source" << "mask");
+        }
+
+        void runKernels(const QVector<cl_mem> &inImages, const QVector<cl_mem> &outImages,
+                        const QSize &size) Q_DECL_OVERRIDE {
+            m_kernel.enqueue(commandQueue(), QQuickCLKernel::Range(size), inImages[0], inImages[1], outImages[0]);
+        }
+    \endcode
+
+    The size of the output is derived from the first source.
+ */
+void QQuickCLImageRunnable::setSourcePropertyNames(const QList<QByteArray> &names)
+{
+    Q_D(QQuickCLImageRunnable);
+    if (names.isEmpty()) {
+        qWarning("QQuickCLImageRunnable needs at least one source");
+        return;
+    }
+    d->cancelComputeJob();
+    for (int i = 0; i < d->sources.count(); ++i) {
+        if (d->sources[i].image)
+            clReleaseMemObject(d->sources[i].image);
+    }
+    QObject::disconnect(0, 0, &d->sourceWatcher, 0);
+    d->sources.clear();
+    for (int i = 0; i < names.count(); ++i)
+        d->sources.append(QQuickCLImageSource(names[i]));
+    d->computedGeneration = 0;
+}
+
+/*!
+    \return the names of the properties the source texture providers are read
+    from.
+ */
+QList<QByteArray> QQuickCLImageRunnable::sourcePropertyNames() const
+{
+    Q_D(const QQuickCLImageRunnable);
+    QList<QByteArray> names;
+    for (int i = 0; i < d->sources.count(); ++i)
+        names.append(d->sources[i].propertyName);
+    return names;
+}
+
+/*!
+    Sets the format of the output texture and OpenCL image with the given \a
+    index to \a format. The default is \c RGBA8.
+
+    Kernels producing masks, depth or high dynamic range data can use a
+    smaller or more precise format than the default. A single channel \c R8
+    output, for example, needs a quarter of the memory and bandwidth. Single
+    channel outputs are shown in grayscale when texture swizzling is
+    supported.
+
+    The format is validated against the image formats supported by the OpenCL
+    context for writing. When it is not supported, a warning is printed, the
+    format stays unchanged and \c false is returned.
+
+    \table
+    \header \li Format \li OpenGL \li OpenCL
+    \row \li \c RGBA8 \li \c GL_RGBA8 \li \c CL_RGBA, \c CL_UNORM_INT8
+    \row \li \c R8 \li \c GL_R8 \li \c CL_R, \c CL_UNORM_INT8
+    \row \li \c RG8 \li \c GL_RG8 \li \c CL_RG, \c CL_UNORM_INT8
+    \row \li \c RGBA16F \li \c GL_RGBA16F \li \c CL_RGBA, \c CL_HALF_FLOAT
+    \row \li \c RGBA32F \li \c GL_RGBA32F \li \c CL_RGBA, \c CL_FLOAT
+    \row \li \c R32F \li \c GL_R32F \li \c CL_R, \c CL_FLOAT
+    \endtable
+
+    \note The format has no effect when the \c NoOutputImage flag is set.
+ */
+bool QQuickCLImageRunnable::setOutputFormat(OutputFormat format, int index)
+{
+    Q_D(QQuickCLImageRunnable);
+    if (index < 0 || index >= d->outputFormats.count()) {
+        qWarning("Invalid output index %d", index);
+        return false;
+    }
+    cl_image_format clFormat;
+    clFormat.image_channel_order = outputFormatTable[format].channelOrder;
+    clFormat.image_channel_data_type = outputFormatTable[format].channelType;
+    // Outputs are read-write since downstream runnables may read them directly.
+    if (!d->clctx->isImageFormatSupported(clFormat, CL_MEM_READ_WRITE)) {
+        qWarning("Output format %d is not supported by the OpenCL implementation", format);
+        return false;
+    }
+    if (d->outputFormats[index] != format) {
+        d->outputFormats[index] = format;
+        d->computedGeneration = 0;
+    }
+    return true;
+}
+
+/*!
+    \return the format of the output texture with the given \a index.
+ */
+QQuickCLImageRunnable::OutputFormat QQuickCLImageRunnable::outputFormat(int index) const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return d->outputFormats.value(index, RGBA8);
+}
+
+/*!
+    Sets the number of output images to \a count. The default is 1.
+
+    Kernels that naturally produce several results in one pass, for example
+    the two directions of a separable blur, luminance and gradient, or a
+    color image and a mask, can write all of them at once instead of reading
+    the sources again in separate items. All outputs have the same size and
+    are passed to runKernels().
+    Their formats are set individually via setOutputFormat(). New outputs
+    default to \c RGBA8.
+
+    The item shows the first output. Every output is exposed as a texture
+    provider via QQuickCLItem::output(), so that ShaderEffect items, or
+    other QQuickCLItem instances, can sample it.
+
+    \note The count has no effect when the \c NoOutputImage flag is set.
+ */
+void QQuickCLImageRunnable::setOutputCount(int count)
+{
+    Q_D(QQuickCLImageRunnable);
+    count = qMax(1, count);
+    const int oldCount = d->outputFormats.count();
+    if (count != oldCount) {
+        d->outputFormats.resize(count);
+        for (int i = oldCount; i < count; ++i)
+            d->outputFormats[i] = RGBA8;
+        d->computedGeneration = 0;
+    }
+}
+
+/*!
+    \return the number of output images.
+ */
+int QQuickCLImageRunnable::outputCount() const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return d->outputFormats.count();
+}
+
+/*!
+    \enum QQuickCLImageRunnable::OutputSizePolicy
+
+    Specifies how the size of the output image is determined.
+
+    \value SourceSize The output has the same size as the source texture.
+    \value FixedSize The output has the size set via setFixedOutputSize().
+    \value ScaledSourceSize The output has the size of the source texture
+    multiplied by the factor set via setOutputScale().
+    \value ItemPixelSize The output has the size of the item in pixels, taking
+    the window's \l{QQuickWindow::effectiveDevicePixelRatio()}{effective
+    device pixel ratio} into account.
+ */
+
+/*!
+    Sets how the size of the output image is determined to \a policy. The
+    default is \c SourceSize.
+
+    Effects that work at a reduced resolution, for example blurs, bloom or
+    thumbnails, can write a smaller output that the scenegraph scales to the
+    item's size, instead of writing a full resolution image. A half
+    resolution output needs only a quarter of the memory bandwidth.
+
+    The output size is bounded by the maximum image size of the device.
+
+    \note The policy has no effect when the \c NoOutputImage flag is set.
+
+    \sa outputSize()
+ */
+void QQuickCLImageRunnable::setOutputSizePolicy(OutputSizePolicy policy)
+{
+    Q_D(QQuickCLImageRunnable);
+    d->outputSizePolicy = policy;
+}
+
+/*!
+    \return the policy for the size of the output image.
+ */
+QQuickCLImageRunnable::OutputSizePolicy QQuickCLImageRunnable::outputSizePolicy() const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return d->outputSizePolicy;
+}
+
+/*!
+    Sets the output size to \a size and the policy to \c FixedSize.
+ */
+void QQuickCLImageRunnable::setFixedOutputSize(const QSize &size)
+{
+    Q_D(QQuickCLImageRunnable);
+    d->fixedOutputSize = size;
+    d->outputSizePolicy = FixedSize;
+}
+
+/*!
+    Sets the scale factor for the output size to \a scale and the policy to \c
+    ScaledSourceSize. For example, a \a scale of 0.5 results in an output
+    with half the width and height of the source.
+ */
+void QQuickCLImageRunnable::setOutputScale(qreal scale)
+{
+    Q_D(QQuickCLImageRunnable);
+    d->outputScale = qMax(qreal(0), scale);
+    d->outputSizePolicy = ScaledSourceSize;
+}
+
+/*!
+    \return the size of the source texture with the given \a index used in the
+    current or last invocation of runKernel().
+ */
+QSize QQuickCLImageRunnable::inputSize(int index) const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return index >= 0 && index < d->sources.count() ? d->sources[index].size : QSize();
+}
+
+/*!
+    \return the size of the output image used in the current or last
+    invocation of runKernel(). This is the same as the \c size argument of
+    runKernel().
+ */
+QSize QQuickCLImageRunnable::outputSize() const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return d->outputSize;
+}
+
+/*!
+    Sets the number of output images to \a depth. The default is 1.
+
+    With the default depth, runKernel() writes into the same output texture
+    every time and the result is shown in the same frame. This requires the
+    OpenGL rendering of the frame to wait for the OpenCL commands.
+
+    With a depth of N, the runnable rotates between N output textures and
+    OpenCL images. runKernel() writes into one that is not currently shown,
+    while the item keeps showing the newest completed result. The render
+    thread does not block on the command queue: completion is detected via
+    event callbacks and the item switches to the new result in a later frame.
+    This allows the OpenCL work for one frame to overlap with rendering the
+    previous one, at the expense of up to N - 1 frames of latency and
+    additional memory for the textures.
+
+    When all outputs are busy, running the kernels is postponed until one of
+    them completes.
+
+    \note Overlapping relies on \c cl_khr_gl_event, that is, on
+    QQuickCLContext::syncMethod() being QQuickCLContext::ImplicitSync. With the
+    other methods, and when the \c Profile or \c ForceCLFinish flags are set,
+    each runKernel() is still waited for in some form, so a larger depth only
+    adds latency.
+
+    \note The depth has no effect when the \c NoOutputImage flag is set.
+ */
+void QQuickCLImageRunnable::setPipelineDepth(int depth)
+{
+    Q_D(QQuickCLImageRunnable);
+    d->pipelineDepth = qMax(1, depth);
+}
+
+/*!
+    \return the number of output images.
+ */
+int QQuickCLImageRunnable::pipelineDepth() const
+{
+    Q_D(const QQuickCLImageRunnable);
+    return d->pipelineDepth;
+}
+
+/*!
+    Registers an asynchronous program build represented by \a future.
+
+    Until all registered builds have finished, runKernel() is not called and
+    the item shows no content. When the \c PassthroughWhilePending flag is set,
+    the source texture is shown unmodified instead. The item is updated
+    automatically once the builds finish.
+
+    This allows creating programs with QQuickCLContext::buildProgramAsync() in
+    the constructor without stalling the render thread and with it every
+    animation in the window.
+
+    \code
+        CLRunnable(QQuickCLItem *item)
+            : QQuickCLImageRunnable(item, PassthroughWhilePending)
+        {
+            m_future = item->context()->buildProgramAsync(openclSrc);
+            addPendingProgram(m_future);
+        }
+
+        void runKernel(cl_mem inImage, cl_mem outImage, const QSize &size) Q_DECL_OVERRIDE {
+            if (!m_kernel && m_future.program())
+                m_kernel = clCreateKernel(m_future.program(), "Kernel", 0);
+            ...
+        }
+    \endcode
+ */
+void QQuickCLImageRunnable::addPendingProgram(const QQuickCLProgramFuture &future)
 {
     Q_D(QQuickCLImageRunnable);
-    d->sourcePropertyName = name;
+    if (future.isFinished())
+        return;
+    d->pendingPrograms.append(future);
+    QQuickCLProgramFuture f(future);
+    f.notifyWhenFinished(d->item);
+}
+
+/*!
+    Marks the parameters of the kernels as changed, so that the next update
+    runs runKernel() even when the source is the same. Only relevant with the
+    \c SkipUnchanged flag.
+
+    \note This function must be called on the render thread, for example from
+    synchronize().
+ */
+void QQuickCLImageRunnable::markDirty()
+{
+    Q_D(QQuickCLImageRunnable);
+    d->parametersDirty = true;
+}
+
+/*!
+    Called on the render thread, with the gui thread blocked, when the kernels
+    are about to be run, before checking whether the computation has to be
+    skipped due to the item's rate or budget, or due to the \c SkipUnchanged
+    flag. Reimplement this function to copy the item's properties that are
+    needed in runKernel() when it runs on a different thread, as is the case
+    with the \c ComputeThread flag, and to call markDirty() when they have
+    changed. The default implementation does nothing.
+ */
+void QQuickCLImageRunnable::synchronize()
+{
 }
 
 QSGNode *QQuickCLImageRunnable::update(QSGNode *node)
 {
     Q_D(QQuickCLImageRunnable);
-    QSGTextureProvider *textureProvider;
-    QSGTexture *texture;
-    QQuickItem *source = d->item->property(d->sourcePropertyName.constData()).value<QQuickItem *>();
-    if (!source
-            || !source->isTextureProvider()
-            || !(textureProvider = source->textureProvider())
-            || !(texture = textureProvider->texture())) {
-        delete node;
-        return 0;
+    QVarLengthArray<QSGTexture *, 4> textures;
+    for (int i = 0; i < d->sources.count(); ++i) {
+        QQuickItem *source = d->item->property(d->sources[i].propertyName.constData()).value<QQuickItem *>();
+        QSGTextureProvider *textureProvider = source && source->isTextureProvider() ? source->textureProvider() : 0;
+        d->watchSource(i, textureProvider);
+        QSGTexture *texture = textureProvider ? textureProvider->texture() : 0;
+        if (!texture) {
+            // For example another QQuickCLItem that has not produced a result yet.
+            if (textureProvider)
+                d->item->scheduleUpdate();
+            delete node;
+            return 0;
+        }
+        textures.append(texture);
     }
+    // The first source is shown as a placeholder.
+    QSGTexture *texture = textures[0];
 
-    QSGDynamicTexture *dtex = qobject_cast<QSGDynamicTexture *>(texture);
-    if (dtex)
-        dtex->updateTexture();
+    bool texturesReady = true;
+    for (int i = 0; i < textures.count(); ++i) {
+        QSGDynamicTexture *dtex = qobject_cast<QSGDynamicTexture *>(textures[i]);
+        if (dtex && dtex->updateTexture())
+            ++d->sourceGeneration;
+        // The output of another runnable may change without a new texture.
+        const quint64 serial = imageSerial(textures[i]);
+        if (serial != d->sources[i].serial) {
+            d->sources[i].serial = serial;
+            ++d->sourceGeneration;
+        }
+        texturesReady &= textures[i]->textureId() != 0;
+    }
 
-    if (!texture->textureId()) { // the texture provider may not be ready yet, try again later
+    if (!texturesReady) { // the texture provider may not be ready yet, try again later
         d->item->scheduleUpdate();
         return node;
     }
 
-    if (d->inputTexture != uint(texture->textureId())
-            || d->textureSize != texture->textureSize()
-            || (!d->flags.testFlag(NoOutputImage) && !d->outputTexture)) {
-        if (d->image[0])
-            clReleaseMemObject(d->image[0]);
-        d->image[0] = 0;
-        if (d->image[1])
-            clReleaseMemObject(d->image[1]);
-        d->image[1] = 0;
-        delete d->outputTexture;
-        d->outputTexture = 0;
+    for (int i = d->pendingPrograms.count() - 1; i >= 0; --i) {
+        if (d->pendingPrograms[i].isFinished())
+            d->pendingPrograms.remove(i);
+    }
+    if (!d->pendingPrograms.isEmpty()) {
+        if (!d->flags.testFlag(PassthroughWhilePending) || d->flags.testFlag(NoOutputImage)) {
+            delete node;
+            d->passthroughNode = false;
+            return 0;
+        }
+        if (!d->passthroughNode) {
+            delete node;
+            node = 0;
+        }
+        QSGSimpleTextureNode *tnode = static_cast<QSGSimpleTextureNode *>(node);
+        if (!tnode) {
+            tnode = new QSGSimpleTextureNode;
+            tnode->setFiltering(QSGTexture::Linear);
+            d->passthroughNode = true;
+        }
+        tnode->setTexture(texture);
+        tnode->setRect(d->item->boundingRect());
+        tnode->markDirty(QSGNode::DirtyMaterial);
+        return tnode;
+    }
+    if (d->passthroughNode) {
         delete node;
         node = 0;
+        d->passthroughNode = false;
+    }
+
+    const bool hasOutput = !d->flags.testFlag(NoOutputImage);
+    const int depth = d->effectivePipelineDepth();
+    const bool depthChanged = hasOutput && d->pipeline && d->pipeline->outputs.count() != depth;
+    bool sourcesChanged = false;
+    for (int i = 0; i < textures.count(); ++i) {
+        sourcesChanged |= d->sources[i].textureId != uint(textures[i]->textureId())
+                || d->sources[i].size != textures[i]->textureSize();
     }
+    if (sourcesChanged || depthChanged) {
+        d->cancelComputeJob();
+        // Only the images of sources that changed are recreated.
+        for (int i = 0; i < textures.count(); ++i) {
+            QQuickCLImageSource &src(d->sources[i]);
+            if (src.image && (src.textureId != uint(textures[i]->textureId()) || src.size != textures[i]->textureSize())) {
+                clReleaseMemObject(src.image);
+                src.image = 0;
+            }
+        }
+        // The outputs and the node are kept. Outputs of the wrong size are
+        // exchanged for pooled ones when they are written next time.
+        if (d->pipeline) {
+            d->pipeline->finish();
+            if (depthChanged)
+                d->pipeline->setDepth(depth);
+        }
+        d->computedGeneration = 0;
+    }
+
+    // The new size is taken into use when the kernels run next time.
+    const QSize outputSize = hasOutput ? d->requestedOutputSize(texture->textureSize()) : texture->textureSize();
+    if (outputSize != d->outputSize)
+        d->computedGeneration = 0;
+
+    if (d->computeThread) {
+        // Only one job per runnable at a time. When the previous one is still
+        // running, done() schedules another update.
+        d->computeDeferred.storeRelease(1);
+        if (d->computeThread->isBusy(d))
+            return hasOutput && d->pipeline ? d->updateOutputNode(node, texture) : 0;
+        d->computeDeferred.storeRelease(0);
+    }
+
+    synchronize();
+
+    if (d->flags.testFlag(SkipUnchanged) && !d->parametersDirty && d->computedGeneration == d->sourceGeneration)
+        return hasOutput ? d->updateOutputNode(node, d->computeThread ? texture : 0) : 0;
+
+    if (!hasOutput || d->pipeline) {
+        // Reuse the previous results when computing again would exceed the item's rate or budget.
+        const int wait = d->throttle();
+        if (wait > 0) {
+            d->item->scheduleUpdate(wait);
+            return hasOutput ? d->updateOutputNode(node, d->computeThread ? texture : 0) : 0;
+        }
+    }
+
+    if (!d->queueProfiling && d->item->computeBudget() > 0)
+        d->enableProfiling();
 
     QQuickCLContext *clctx = d->item->context();
     Q_ASSERT(clctx);
     cl_int err = 0;
-    if (!d->image[0])
-        d->image[0] = clCreateFromGLTexture2D(clctx->context(), CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0,
-                                              texture->textureId(), &err);
-    if (!d->image[0]) {
-        if (err == CL_INVALID_GL_OBJECT) // the texture provider may not be ready yet, try again later
-            d->item->scheduleUpdate();
-        else
-            qWarning("Failed to create OpenCL image object from input OpenGL texture: %d", err);
-        return node;
+    for (int i = 0; i < textures.count(); ++i) {
+        QQuickCLImageSource &src(d->sources[i]);
+        // The output of another runnable written on the same queue is used
+        // as-is. Otherwise the texture is wrapped like any other, switching
+        // when the producer moves to another queue.
+        cl_mem shared = sharedImage(textures[i], clctx->context(), d->queue);
+        if (src.image && (src.shared ? shared != src.image : shared != 0)) {
+            clReleaseMemObject(src.image);
+            src.image = 0;
+        }
+        if (!src.image) {
+            src.shared = shared != 0;
+            src.image = shared ? shared : clCreateFromGLTexture2D(clctx->context(), CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0,
+                                                                  textures[i]->textureId(), &err);
+        } else if (shared) {
+            clReleaseMemObject(shared);
+        }
+        if (!src.image) {
+            if (err == CL_INVALID_GL_OBJECT) // the texture provider may not be ready yet, try again later
+                d->item->scheduleUpdate();
+            else
+                qWarning("Failed to create OpenCL image object from input OpenGL texture: %d", err);
+            return node;
+        }
+    }
+
+    d->inputImages.resize(textures.count());
+    for (int i = 0; i < textures.count(); ++i) {
+        QQuickCLImageSource &src(d->sources[i]);
+        src.textureId = textures[i]->textureId();
+        src.size = textures[i]->textureSize();
+        d->inputImages[i] = src.image;
     }
+    d->outputSize = outputSize;
 
-    d->inputTexture = texture->textureId();
-    d->textureSize = texture->textureSize();
+    QQuickCLImageSlot *slot = 0;
+    int slotIndex = -1;
+    if (hasOutput) {
+        if (!d->pipeline)
+            d->pipeline.reset(new QQuickCLImagePipeline(d->item, d->queue, depth));
+        QQuickCLImagePipeline *pipeline = d->pipeline.data();
+        pipeline->poll();
+        slotIndex = pipeline->freeSlot();
+        if (slotIndex < 0) {
+            // Everything is either shown or still being computed. Try again
+            // when a slot completes instead of blocking here.
+            pipeline->deferred = true;
+            return d->updateOutputNode(node, d->computeThread ? texture : 0);
+        }
+        slot = &pipeline->outputs[slotIndex];
+        if (!pipeline->allocate(slot, d->outputSize, d->outputFormats))
+            return d->updateOutputNode(node);
+    }
+    d->outputImages.clear();
+    if (slot) {
+        for (int i = 0; i < slot->targets.count(); ++i) {
+            d->outputImages.append(slot->targets[i].image);
+            touchImage(slot->targets[i].sgTexture, d->queue);
+        }
+    }
+    d->images = d->inputImages + d->outputImages;
+    d->slot = slot;
 
-    const int imageCount = d->flags.testFlag(NoOutputImage) ? 1 : 2;
-    if (imageCount == 2) {
-        if (!d->outputTexture)
-            d->outputTexture = new QOpenGLTexture(QImage(d->textureSize, QImage::Format_RGB32));
+    d->computedGeneration = d->sourceGeneration;
+    d->parametersDirty = false;
+    d->lastCompute = d->clock.elapsed();
+    d->measureKernelTime = d->item->computeBudget() > 0;
 
-        if (!d->image[1])
-            d->image[1] = clCreateFromGLTexture2D(clctx->context(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0,
-                                                  d->outputTexture->textureId(), &err);
-        if (!d->image[1]) {
-            qWarning("Failed to create OpenCL image object for output OpenGL texture: %d", err);
-            return node;
+    if (d->computeThread) {
+        QQuickCLContextPrivate *clctxD = QQuickCLContextPrivate::get(clctx);
+        // The previous job has been enqueued, its acquire does not need the old fence anymore.
+        clctxD->deleteGLFence(d->acquireFence);
+        d->computeWait = clctxD->syncBeforeAcquireOnOtherThread(&d->acquireFence);
+        d->computeSlot = slotIndex;
+        if (slot) {
+            slot->serial = ++d->pipeline->lastSerial;
+            slot->inFlight = true;
+            slot->pending = true;
         }
+        d->computeThread->post(d);
+        // Until the first result arrives, the source is shown.
+        return hasOutput ? d->updateOutputNode(node, texture) : 0;
     }
 
-    if (d->needsExplicitSync)
-        QOpenGLContext::currentContext()->functions()->glFinish();
+    if (d->scheduler) {
+        // Everything else happens when the scheduler submits the jobs of all
+        // items after synchronizing.
+        d->scheduler->addJob(d);
+        if (!hasOutput)
+            return 0;
+        if (depth == 1) {
+            // The texture is written before rendering the frame, so it can be shown right away.
+            slot->serial = ++d->pipeline->lastSerial;
+            slot->inFlight = true;
+            d->pipeline->poll();
+        }
+        return d->updateOutputNode(node);
+    }
 
-    err = clEnqueueAcquireGLObjects(d->queue, imageCount, d->image, 0, 0, 0);
+    clctx->syncBeforeAcquire();
+
+    err = clEnqueueAcquireGLObjects(d->queue, d->images.count(), d->images.constData(), 0, 0, 0);
     if (err != CL_SUCCESS) {
         qWarning("Failed to queue acquiring the GL textures: %d", err);
         return node;
     }
 
-    if (d->flags.testFlag(Profile))
-        if (clEnqueueMarker(d->queue, &d->profEv[0]) != CL_SUCCESS)
+    d->enqueue();
+
+    const bool pipelined = slot && depth > 1;
+    const bool needsReleaseEvent = pipelined || clctx->syncMethod() != QQuickCLContext::ImplicitSync;
+    cl_event releaseEvent = 0;
+    clEnqueueReleaseGLObjects(d->queue, d->images.count(), d->images.constData(), 0, 0,
+                              needsReleaseEvent ? &releaseEvent : 0);
+
+    if (d->needsFinish()) {
+        clFinish(d->queue);
+    } else {
+        clctx->syncAfterRelease(d->queue, releaseEvent);
+        if (pipelined)
+            clFlush(d->queue); // make sure the commands get submitted, the event would never complete otherwise
+    }
+
+    d->submitted(releaseEvent);
+    if (releaseEvent)
+        clReleaseEvent(releaseEvent);
+
+    return hasOutput ? d->updateOutputNode(node) : 0;
+}
+
+QVector<cl_mem> QQuickCLImageRunnablePrivate::glObjects() const
+{
+    return images;
+}
+
+QVector<cl_mem> QQuickCLImageRunnablePrivate::writtenObjects() const
+{
+    return outputImages;
+}
+
+void QQuickCLImageRunnablePrivate::enqueue()
+{
+    Q_Q(QQuickCLImageRunnable);
+
+    if (flags.testFlag(QQuickCLImageRunnable::Profile))
+        if (clEnqueueMarker(queue, &profEv[0]) != CL_SUCCESS)
             qWarning("Failed to enqueue profiling marker (start)");
 
-    runKernel(d->image[0], d->image[1], d->textureSize);
+    // Only one measurement at a time, the previous one is collected in throttle().
+    const bool measure = measureKernelTime && queueProfiling && !flags.testFlag(QQuickCLImageRunnable::Profile) && !budgetEv[0];
+    if (measure && clEnqueueMarker(queue, &budgetEv[0]) != CL_SUCCESS)
+        budgetEv[0] = 0;
 
-    if (d->flags.testFlag(Profile))
-        if (clEnqueueMarker(d->queue, &d->profEv[1]) != CL_SUCCESS)
-            qWarning("Failed to enqueue profiling marker (end)");
+    q->runKernels(inputImages, outputImages, outputSize);
 
-    clEnqueueReleaseGLObjects(d->queue, imageCount, d->image, 0, 0, 0);
+    if (measure && budgetEv[0] && clEnqueueMarker(queue, &budgetEv[1]) != CL_SUCCESS) {
+        clReleaseEvent(budgetEv[0]);
+        budgetEv[0] = budgetEv[1] = 0;
+    }
 
-    if (d->flags.testFlag(ForceCLFinish) || d->needsExplicitSync || d->flags.testFlag(Profile))
-        clFinish(d->queue);
+    if (flags.testFlag(QQuickCLImageRunnable::Profile))
+        if (clEnqueueMarker(queue, &profEv[1]) != CL_SUCCESS)
+            qWarning("Failed to enqueue profiling marker (end)");
+}
 
-    if (d->flags.testFlag(Profile)) {
+bool QQuickCLImageRunnablePrivate::needsFinish() const
+{
+    return flags.testFlag(QQuickCLImageRunnable::ForceCLFinish) || flags.testFlag(QQuickCLImageRunnable::Profile);
+}
+
+void QQuickCLImageRunnablePrivate::submitted(cl_event releaseEvent)
+{
+    if (flags.testFlag(QQuickCLImageRunnable::Profile)) {
         cl_ulong start = 0, end = 0;
-        err = clGetEventProfilingInfo(d->profEv[0], CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &start, 0);
+        cl_int err = clGetEventProfilingInfo(profEv[0], CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &start, 0);
         if (err != CL_SUCCESS)
             qWarning("Failed to get profiling info for start event: %d", err);
-        err = clGetEventProfilingInfo(d->profEv[1], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, 0);
+        err = clGetEventProfilingInfo(profEv[1], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, 0);
         if (err != CL_SUCCESS)
             qWarning("Failed to get profiling info for end event: %d", err);
-        d->elapsed = double(end - start) / 1000000.0;
-        clReleaseEvent(d->profEv[0]);
-        clReleaseEvent(d->profEv[1]);
+        elapsed = double(end - start) / 1000000.0;
+        clReleaseEvent(profEv[0]);
+        clReleaseEvent(profEv[1]);
     }
 
-    if (imageCount == 1)
-        return 0;
+    if (!slot)
+        return;
 
-    QSGSimpleTextureNode *tnode = static_cast<QSGSimpleTextureNode *>(node);
-    if (!tnode) {
-        tnode = new QSGSimpleTextureNode;
-        tnode->setFiltering(QSGTexture::Linear);
-        tnode->setTexture(d->item->window()->createTextureFromId(d->outputTexture->textureId(), d->textureSize));
+    QQuickCLImagePipeline *p = pipeline.data();
+    if (effectivePipelineDepth() > 1) {
+        if (releaseEvent) {
+            clRetainEvent(releaseEvent);
+            slot->done = releaseEvent;
+        }
+        slot->serial = ++p->lastSerial;
+        slot->inFlight = true;
+    } else if (!scheduler) {
+        slot->serial = ++p->lastSerial;
+        slot->inFlight = true;
     }
-    tnode->setRect(d->item->boundingRect());
-    tnode->markDirty(QSGNode::DirtyMaterial);
+    if (slot->done) {
+        // Nothing to show yet, this is the only time the pipeline waits.
+        if (p->displayed < 0) {
+            clWaitForEvents(1, &slot->done);
+            if (scheduler) // the node was not created during synchronization
+                item->scheduleUpdate();
+        } else {
+            p->watch(slot);
+        }
+    }
+    p->poll();
+    slot = 0;
+}
 
-    return tnode;
+void QQuickCLImageRunnablePrivate::run(cl_command_queue computeQueue)
+{
+    // compute thread, the render thread does not touch the images or the slot until done()
+    Q_ASSERT(computeQueue == queue);
+    Q_UNUSED(computeQueue);
+
+    cl_int err = clEnqueueAcquireGLObjects(queue, images.count(), images.constData(),
+                                           computeWait ? 1 : 0, computeWait ? &computeWait : 0, 0);
+    if (computeWait) {
+        clReleaseEvent(computeWait);
+        computeWait = 0;
+    }
+    cl_event releaseEvent = 0;
+    if (err == CL_SUCCESS) {
+        enqueue();
+        clEnqueueReleaseGLObjects(queue, images.count(), images.constData(), 0, 0, &releaseEvent);
+    } else {
+        qWarning("Failed to queue acquiring the GL textures: %d", err);
+    }
+    if (flags.testFlag(QQuickCLImageRunnable::ForceCLFinish))
+        clFinish(queue);
+    else
+        clFlush(queue); // the release event would never complete otherwise
+
+    if (computeSlot < 0) {
+        if (releaseEvent)
+            clReleaseEvent(releaseEvent);
+        return;
+    }
+    pipeline->handoff(computeSlot, releaseEvent);
+    computeSlot = -1;
+    // The node picks up the event in preprocess() and watches it from there on.
+    channel->scheduleWindowUpdate();
+}
+
+void QQuickCLImageRunnablePrivate::done()
+{
+    // compute thread. update() was called while the job was still running, try again now.
+    if (computeDeferred.testAndSetOrdered(1, 0))
+        channel->scheduleUpdate();
+}
+
+/*!
+    Waits for a computation running on the compute thread and removes pending
+    ones, since they would call runKernel() on an object that is partially
+    destroyed otherwise.
+ */
+void QQuickCLImageRunnable::aboutToBeDeleted()
+{
+    Q_D(QQuickCLImageRunnable);
+    if (d->computeThread)
+        d->computeThread->cancel(d);
+    QQuickCLRunnable::aboutToBeDeleted();
 }
 
 /*!
@@ -39,6 +39,10 @@
 
 #include <QtQuickCL/qtquickclglobal.h>
 #include <QtQuickCL/qquickclrunnable.h>
+#include <QtQuickCL/qquickclprogramfuture.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qvector.h>
+#include <QtCore/qbytearray.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -53,21 +57,68 @@ public:
     enum Flag {
         NoOutputImage = 0x01,
         Profile = 0x02,
-        ForceCLFinish = 0x04
+        ForceCLFinish = 0x04,
+        PassthroughWhilePending = 0x08,
+        BatchedSubmission = 0x10,
+        ComputeThread = 0x20,
+        SkipUnchanged = 0x40
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
+    enum OutputFormat {
+        RGBA8,
+        R8,
+        RG8,
+        RGBA16F,
+        RGBA32F,
+        R32F
+    };
+
+    enum OutputSizePolicy {
+        SourceSize,
+        FixedSize,
+        ScaledSourceSize,
+        ItemPixelSize
+    };
+
     QQuickCLImageRunnable(QQuickCLItem *item, Flags flags = 0);
     ~QQuickCLImageRunnable();
 
     cl_command_queue commandQueue() const;
 
     void setSourcePropertyName(const QByteArray &name);
+    void setSourcePropertyNames(const QList<QByteArray> &names);
+    QList<QByteArray> sourcePropertyNames() const;
+
+    bool setOutputFormat(OutputFormat format, int index = 0);
+    OutputFormat outputFormat(int index = 0) const;
+
+    void setOutputCount(int count);
+    int outputCount() const;
+
+    void setOutputSizePolicy(OutputSizePolicy policy);
+    OutputSizePolicy outputSizePolicy() const;
+    void setFixedOutputSize(const QSize &size);
+    void setOutputScale(qreal scale);
+
+    QSize inputSize(int index = 0) const;
+    QSize outputSize() const;
+
+    void setPipelineDepth(int depth);
+    int pipelineDepth() const;
+
+    void addPendingProgram(const QQuickCLProgramFuture &future);
+
+    void markDirty();
 
     double elapsed() const;
 
+    void aboutToBeDeleted() Q_DECL_OVERRIDE;
+
 protected:
-    virtual void runKernel(cl_mem inImage, cl_mem outImage, const QSize &size) = 0;
+    virtual void runKernel(cl_mem inImage, cl_mem outImage, const QSize &size);
+    virtual void runKernels(const QVector<cl_mem> &inImages, const QVector<cl_mem> &outImages, const QSize &size);
+    virtual void synchronize();
 
 private:
     QSGNode *update(QSGNode *node) Q_DECL_OVERRIDE;
@@ -34,13 +34,13 @@
 **
 ****************************************************************************/
 
-#include "qquickclitem.h"
-#include "qquickclcontext.h"
-#include <QtCore/QAtomicInt>
+#include "qquickclitem_p.h"
+#include "qquickclcontext_p.h"
 #include <QtCore/QHash>
 #include <QtCore/QFile>
+#include <QtCore/QVector>
 #include <QtCore/QLoggingCategory>
-#include <QtQuick/private/qquickitem_p.h>
+#include <QtQuick/QSGTextureProvider>
 
 QT_BEGIN_NAMESPACE
 
@@ -52,8 +52,18 @@ Q_DECLARE_LOGGING_CATEGORY(logCL)
     \brief QQuickCLItem is a QQuickItem that automatically gets an OpenCL
     context with the proper platform and device chosen for CL-GL interop.
 
-    Each instance of QQuickCLItem is backed by a QQuickCLContext and
-    QQuickCLRunnable instance.
+    Each instance of QQuickCLItem is backed by a QQuickCLRunnable instance.
+    All items rendered with the same OpenGL context share a single
+    QQuickCLContext, meaning OpenCL programs, buffers and images can be shared
+    between them. The context is released when the last item using it goes
+    away.
+
+    The textures produced by the runnable can be used by other items via
+    output(), which returns a texture provider item for each output. The
+    item itself is a texture provider for the first output, so it can be
+    used directly as the source of another QQuickCLItem or a ShaderEffect.
+    The providers emit \c textureChanged() for every new result, also when it
+    is written to the same texture as the previous one.
 
      \note When animating properties that are used in OpenCL kernels, call the
      \l{QQuickItem::update()}{update()} function (from the gui thread) to
@@ -96,31 +106,223 @@ Q_DECLARE_LOGGING_CATEGORY(logCL)
     QQuickCLItem::scheduleUpdate() instead of QQuickItem::update().
  */
 
+/*!
+    Called on the render thread when \a event, registered via
+    QQuickCLItem::watchEvent() with QQuickCLItem::RenderThread delivery,
+    completes. The default implementation does nothing.
+
+    The call happens during the scenegraph's synchronization step, right
+    before update(). Results that stay on the GPU, for example a buffer shared
+    with OpenGL, can therefore be used in the same frame without going
+    through the gui thread.
+ */
+void QQuickCLRunnable::eventCompletedOnRenderThread(cl_event event)
+{
+    Q_UNUSED(event);
+}
+
+/*!
+    Called on the render thread right before QQuickCLItem deletes the
+    runnable, while the object is still complete. The default implementation
+    does nothing.
+
+    Runnables that let other threads call their virtual functions, for
+    example a compute thread invoking a kernel, must stop that work here. By
+    the time the destructor of a base class runs, the parts of the object
+    belonging to subclasses are already destroyed. Reimplementations must
+    call the base class implementation.
+ */
+void QQuickCLRunnable::aboutToBeDeleted()
+{
+}
+
 /*!
     \fn QQuickCLRunnable *QQuickCLItem::createCL()
 
     Factory function invoked on the render thread after initializing OpenCL.
  */
 
-class QQuickCLItemPrivate : public QQuickItemPrivate
+static void freeRecords(QQuickCLEventRecord *rec)
+{
+    while (rec) {
+        QQuickCLEventRecord *next = rec->next;
+        delete rec;
+        rec = next;
+    }
+}
+
+QQuickCLEventChannel::~QQuickCLEventChannel()
+{
+    freeRecords(completed[QQuickCLItem::GuiThread].load());
+    freeRecords(completed[QQuickCLItem::RenderThread].load());
+    freeRecords(pool);
+}
+
+QQuickCLEventRecord *QQuickCLEventChannel::allocate(cl_event event, QQuickCLItem::EventDelivery delivery)
+{
+    QQuickCLEventRecord *rec = 0;
+    {
+        QMutexLocker lock(&poolMutex);
+        if (pool) {
+            rec = pool;
+            pool = rec->next;
+        }
+    }
+    if (!rec)
+        rec = new QQuickCLEventRecord;
+    rec->next = 0;
+    rec->event = event;
+    rec->channel = this;
+    rec->delivery = delivery;
+    ref.ref(); // released by the callback
+    return rec;
+}
+
+void QQuickCLEventChannel::recycle(QQuickCLEventRecord *first, QQuickCLEventRecord *last)
 {
-    Q_DECLARE_PUBLIC(QQuickCLItem)
+    QMutexLocker lock(&poolMutex);
+    last->next = pool;
+    pool = first;
+}
 
+// Exposes one output texture of the runnable. Lives on the render thread.
+class QQuickCLTextureProvider : public QSGTextureProvider
+{
 public:
-    QQuickCLItemPrivate() : clctx(0), clnode(0) { }
+    QQuickCLTextureProvider(QSGTexture *texture) : m_texture(texture) { }
 
-    static void CL_CALLBACK eventCallback(cl_event event, cl_int status, void *user_data);
+    QSGTexture *texture() const Q_DECL_OVERRIDE { return m_texture; }
 
-    QQuickCLContext *clctx;
-    QQuickCLRunnable *clnode;
+    // Also signals a change when only the content of the texture changed, so
+    // that items reading from it update.
+    void setTexture(QSGTexture *texture, bool contentChanged)
+    {
+        if (m_texture != texture || contentChanged) {
+            m_texture = texture;
+            emit textureChanged();
+        }
+    }
+
+private:
+    QSGTexture *m_texture;
+};
+
+// A child item for each output requested via QQuickCLItem::output(), so that
+// outputs can be used wherever QML expects a texture provider item.
+class QQuickCLItemOutput : public QQuickItem
+{
+public:
+    QQuickCLItemOutput(QQuickCLItem *item, int index) : QQuickItem(item), m_item(item), m_index(index) { }
+
+    bool isTextureProvider() const Q_DECL_OVERRIDE { return true; }
+    QSGTextureProvider *textureProvider() const Q_DECL_OVERRIDE;
+
+private:
+    QQuickCLItem *m_item;
+    int m_index;
+};
+
+QQuickCLItemRenderState::~QQuickCLItemRenderState()
+{
+    // Normally the last reference is dropped on the render thread after releaseProviders().
+    qDeleteAll(providers);
+}
+
+QQuickCLItemRenderState *QQuickCLItemRenderState::acquire(QQuickCLItem *item)
+{
+    QQuickCLItemRenderState *state = QQuickCLItemPrivate::get(item)->renderState;
+    state->ref.ref();
+    return state;
+}
+
+QQuickCLTextureProvider *QQuickCLItemRenderState::provider(int index)
+{
+    // render thread
+    if (providers.count() <= index)
+        providers.resize(index + 1);
+    if (!providers[index])
+        providers[index] = new QQuickCLTextureProvider(outputTextures.value(index));
+    return providers[index];
+}
+
+void QQuickCLItemRenderState::setOutputTexture(QSGTexture *texture, int index, bool contentChanged)
+{
+    // render thread
+    if (outputTextures.count() <= index)
+        outputTextures.resize(index + 1);
+    outputTextures[index] = texture;
+    if (index < providers.count() && providers[index])
+        providers[index]->setTexture(texture, contentChanged);
+}
+
+void QQuickCLItemRenderState::releaseProviders()
+{
+    // render thread. Users of the providers get notified via destroyed().
+    qDeleteAll(providers);
+    providers.clear();
+    outputTextures.clear();
+}
+
+QSGTextureProvider *QQuickCLItemOutput::textureProvider() const
+{
+    // render thread
+    return QQuickCLItemPrivate::get(m_item)->renderState->provider(m_index);
+}
+
+class ReleaseRenderStateRunnable : public QRunnable
+{
+public:
+    ReleaseRenderStateRunnable(QQuickCLItemRenderState *state) : state(state) { }
+    void run() Q_DECL_OVERRIDE {
+        state->releaseProviders();
+        state->deref();
+    }
+private:
+    QQuickCLItemRenderState *state;
 };
 
 QQuickCLItem::QQuickCLItem(QQuickItem *parent)
     : QQuickItem(*new QQuickCLItemPrivate, parent)
 {
+    Q_D(QQuickCLItem);
+    d->channel = new QQuickCLEventChannel(this);
+    d->renderState = new QQuickCLItemRenderState;
     setFlag(ItemHasContents);
 }
 
+/*!
+    \internal
+ */
+QQuickCLItem::QQuickCLItem(QQuickCLItemPrivate &dd, QQuickItem *parent)
+    : QQuickItem(dd, parent)
+{
+    Q_D(QQuickCLItem);
+    d->channel = new QQuickCLEventChannel(this);
+    d->renderState = new QQuickCLItemRenderState;
+    setFlag(ItemHasContents);
+}
+
+/*!
+    Destroys the item. Event callbacks for events passed to watchEvent() that
+    complete afterwards are ignored.
+ */
+QQuickCLItem::~QQuickCLItem()
+{
+    Q_D(QQuickCLItem);
+    {
+        QMutexLocker lock(&d->channel->itemMutex);
+        d->channel->item = 0;
+    }
+    d->channel->deref();
+    // The providers belong to the render thread. Without a window they have
+    // already been released by the job scheduled in releaseResources(), which
+    // holds its own reference.
+    if (window())
+        window()->scheduleRenderJob(new ReleaseRenderStateRunnable(d->renderState), QQuickWindow::BeforeSynchronizingStage);
+    else
+        d->renderState->deref();
+}
+
 /*!
   \return the associated QQuickCLContext.
 
@@ -145,32 +347,56 @@ QSGNode *QQuickCLItem::updatePaintNode(QSGNode *node, UpdatePaintNodeData *)
 
     // render thread, initialize CL if not yet done
     if (!d->clctx) {
-        d->clctx = new QQuickCLContext;
-        if (!d->clctx->create()) {
+        d->clctx = QQuickCLContextPrivate::acquireShared();
+        if (!d->clctx)
             qWarning("Failed to create OpenCL context");
-            delete d->clctx;
-            d->clctx = 0;
-        }
     }
 
     if (!d->clctx)
         return 0;
 
-    if (!d->clnode)
+    if (!d->clnode) {
+        // Completions for a previous runnable are of no use for the new one.
+        QQuickCLEventRecord *last;
+        if (QQuickCLEventRecord *stale = d->channel->take(RenderThread, &last))
+            d->channel->recycle(stale, last);
         d->clnode = createCL();
+    }
+
+    if (!d->clnode)
+        return 0;
+
+    d->deliverRenderThreadEvents();
 
-    return d->clnode ? d->clnode->update(node) : 0;
+    return d->clnode->update(node);
+}
+
+void QQuickCLItemPrivate::deliverRenderThreadEvents()
+{
+    // render thread, gui thread blocked
+    QQuickCLEventRecord *last;
+    QQuickCLEventRecord *list = channel->take(QQuickCLItem::RenderThread, &last);
+    for (QQuickCLEventRecord *rec = list; rec; rec = rec->next)
+        clnode->eventCompletedOnRenderThread(rec->event);
+    if (list)
+        channel->recycle(list, last);
 }
 
 class ReleaseRunnable : public QRunnable
 {
 public:
-    ReleaseRunnable(QQuickCLContext *clctx, QQuickCLRunnable *clnode) : clctx(clctx), clnode(clnode) { }
+    ReleaseRunnable(QQuickCLItemRenderState *state, QQuickCLContext *clctx, QQuickCLRunnable *clnode)
+        : state(state), clctx(clctx), clnode(clnode) { }
     void run() Q_DECL_OVERRIDE {
+        state->releaseProviders();
+        state->deref();
+        if (clnode)
+            clnode->aboutToBeDeleted();
         delete clnode;
-        delete clctx;
+        QQuickCLContextPrivate::releaseShared(clctx);
     }
 private:
+    QQuickCLItemRenderState *state;
     QQuickCLContext *clctx;
     QQuickCLRunnable *clnode;
 };
@@ -179,7 +405,8 @@ void QQuickCLItem::releaseResources()
 {
     // gui thread, just schedule. NB this and d may be dead by the time the runnable is run
     Q_D(QQuickCLItem);
-    window()->scheduleRenderJob(new ReleaseRunnable(d->clctx, d->clnode), QQuickWindow::BeforeSynchronizingStage);
+    window()->scheduleRenderJob(new ReleaseRunnable(QQuickCLItemRenderState::acquire(this), d->clctx, d->clnode),
+                                QQuickWindow::BeforeSynchronizingStage);
     d->clnode = 0;
     d->clctx = 0;
 }
@@ -188,55 +415,235 @@ void QQuickCLItem::invalidateSceneGraph()
 {
     // render thread
     Q_D(QQuickCLItem);
+    d->renderState->releaseProviders();
+    if (d->clnode)
+        d->clnode->aboutToBeDeleted();
     delete d->clnode;
     d->clnode = 0;
-    delete d->clctx;
+    QQuickCLContextPrivate::releaseShared(d->clctx);
     d->clctx = 0;
 }
 
 static const int EV_UPDATE = QEvent::User + 128;
 static const int EV_EVENT = QEvent::User + 129;
+static const int EV_DELAYED_UPDATE = QEvent::User + 130;
+static const int EV_WINDOW_UPDATE = QEvent::User + 131;
 
-class EventCompleteEvent : public QEvent
+class QQuickCLDelayedUpdateEvent : public QEvent
 {
 public:
-    EventCompleteEvent(cl_event event) : QEvent(QEvent::Type(EV_EVENT)), event(event) { }
-    cl_event event;
+    QQuickCLDelayedUpdateEvent(int delay) : QEvent(QEvent::Type(EV_DELAYED_UPDATE)), delay(delay) { }
+    int delay;
 };
 
+void QQuickCLEventChannel::push(QQuickCLEventRecord *rec)
+{
+    // any thread
+    QAtomicPointer<QQuickCLEventRecord> &stack(completed[rec->delivery]);
+    const QQuickCLItem::EventDelivery delivery = rec->delivery;
+    QQuickCLEventRecord *head;
+    do {
+        head = stack.loadAcquire();
+        rec->next = head;
+    } while (!stack.testAndSetRelease(head, rec));
+
+    if (!head) {
+        QMutexLocker lock(&itemMutex);
+        if (item) {
+            if (delivery == QQuickCLItem::GuiThread)
+                QCoreApplication::postEvent(item, new QEvent(QEvent::Type(EV_EVENT)));
+            else
+                item->scheduleUpdate(); // delivered in the next updatePaintNode()
+        }
+    }
+}
+
+QQuickCLEventChannel *QQuickCLEventChannel::acquire(QQuickCLItem *item)
+{
+    QQuickCLEventChannel *channel = QQuickCLItemPrivate::get(item)->channel;
+    channel->ref.ref();
+    return channel;
+}
+
+// Calls QQuickCLItem::scheduleUpdate() unless the item is gone. Any thread.
+void QQuickCLEventChannel::scheduleUpdate()
+{
+    QMutexLocker lock(&itemMutex);
+    if (item)
+        item->scheduleUpdate();
+}
+
+// Requests a new frame from the item's window, without updating the item.
+// Any thread. The window is looked up on the gui thread.
+void QQuickCLEventChannel::scheduleWindowUpdate()
+{
+    QMutexLocker lock(&itemMutex);
+    if (item)
+        QCoreApplication::postEvent(item, new QEvent(QEvent::Type(EV_WINDOW_UPDATE)));
+}
+
+// Takes all completed events for the given thread, in order of completion.
+QQuickCLEventRecord *QQuickCLEventChannel::take(QQuickCLItem::EventDelivery delivery, QQuickCLEventRecord **last)
+{
+    QQuickCLEventRecord *list = completed[delivery].fetchAndStoreAcquire(0);
+
+    // The stack is in reverse order of completion.
+    QQuickCLEventRecord *ordered = 0;
+    *last = list;
+    while (list) {
+        QQuickCLEventRecord *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    return ordered;
+}
+
 bool QQuickCLItem::event(QEvent *e)
 {
+    Q_D(QQuickCLItem);
     if (e->type() == EV_UPDATE) {
+        d->updatePending.storeRelease(0);
         update();
         return true;
     } else if (e->type() == EV_EVENT) {
-        EventCompleteEvent *ev = static_cast<EventCompleteEvent *>(e);
-        eventCompleted(ev->event);
+        QQuickCLEventRecord *last;
+        QQuickCLEventRecord *list = d->channel->take(GuiThread, &last);
+        for (QQuickCLEventRecord *rec = list; rec; rec = rec->next)
+            eventCompleted(rec->event);
+        if (list)
+            d->channel->recycle(list, last);
+        return true;
+    } else if (e->type() == EV_DELAYED_UPDATE) {
+        // Only the first request posts an event, the flag stays set until the timer fires.
+        d->delayedUpdate.start(static_cast<QQuickCLDelayedUpdateEvent *>(e)->delay, this);
+        return true;
+    } else if (e->type() == EV_WINDOW_UPDATE) {
+        if (window())
+            window()->update();
         return true;
     }
     return QQuickItem::event(e);
 }
 
+void QQuickCLItem::timerEvent(QTimerEvent *e)
+{
+    Q_D(QQuickCLItem);
+    if (e->timerId() == d->delayedUpdate.timerId()) {
+        d->delayedUpdate.stop();
+        d->delayedUpdatePending.storeRelease(0);
+        update();
+        return;
+    }
+    QQuickItem::timerEvent(e);
+}
+
 /*!
     Schedules an update for the item. Unlike \l{QQuickItem::update()}{the base
     class' update()}, this is safe to be called on any thread, hence it is safe
     for use from CL event callbacks.
+
+    Calls made while a previously scheduled update is still pending are
+    coalesced, so calling this function frequently is cheap.
  */
 void QQuickCLItem::scheduleUpdate()
 {
-    QCoreApplication::postEvent(this, new QEvent(QEvent::Type(EV_UPDATE)));
+    Q_D(QQuickCLItem);
+    if (d->updatePending.testAndSetAcquire(0, 1))
+        QCoreApplication::postEvent(this, new QEvent(QEvent::Type(EV_UPDATE)));
 }
 
-struct EventCallbackParam
+/*!
+    \overload
+
+    Schedules an update for the item in \a delay milliseconds. Like
+    scheduleUpdate(), this is safe to be called on any thread. While a delayed
+    update is pending, further requests do not postpone it.
+ */
+void QQuickCLItem::scheduleUpdate(int delay)
 {
-    EventCallbackParam(QQuickCLItem *item) : item(item) { }
-    QPointer<QQuickCLItem> item;
-};
+    Q_D(QQuickCLItem);
+    if (delay <= 0)
+        scheduleUpdate();
+    else if (d->delayedUpdatePending.testAndSetAcquire(0, 1))
+        QCoreApplication::postEvent(this, new QQuickCLDelayedUpdateEvent(delay));
+}
+
+/*!
+    \property QQuickCLItem::maximumComputeRate
+
+    The maximum number of times per second the OpenCL computations of the item
+    are run. Updates arriving more often than this reuse the previous results.
+    The default value is 0, meaning no limit.
+
+    \note This is a hint for the runnable. QQuickCLImageRunnable honors it,
+    custom QQuickCLRunnable implementations may query it on the render thread
+    from update().
+ */
+qreal QQuickCLItem::maximumComputeRate() const
+{
+    Q_D(const QQuickCLItem);
+    return d->maximumComputeRate;
+}
+
+void QQuickCLItem::setMaximumComputeRate(qreal rate)
+{
+    Q_D(QQuickCLItem);
+    rate = qMax(qreal(0), rate);
+    if (d->maximumComputeRate != rate) {
+        d->maximumComputeRate = rate;
+        emit maximumComputeRateChanged();
+        update();
+    }
+}
 
 /*!
-    Registers an event callback for \a event. The virtual function
-    eventCompleted() will get invoked on the gui/main thread when the event
-    completes.
+    \property QQuickCLItem::computeBudget
+
+    The GPU time, in milliseconds per displayed frame, the OpenCL computations
+    of the item may use on average. When the measured duration of the kernels
+    exceeds the budget, subsequent updates are skipped, reusing the previous
+    results, so that a slow computation does not drag the frame rate of the
+    user interface below the refresh rate of the screen. The default value is
+    0, meaning no limit.
+
+    \note Like maximumComputeRate, this is a hint for the runnable.
+ */
+qreal QQuickCLItem::computeBudget() const
+{
+    Q_D(const QQuickCLItem);
+    return d->computeBudget;
+}
+
+void QQuickCLItem::setComputeBudget(qreal budget)
+{
+    Q_D(QQuickCLItem);
+    budget = qMax(qreal(0), budget);
+    if (d->computeBudget != budget) {
+        d->computeBudget = budget;
+        emit computeBudgetChanged();
+        update();
+    }
+}
+
+/*!
+    \enum QQuickCLItem::EventDelivery
+
+    Specifies where the completion of an event registered via watchEvent() is
+    reported.
+
+    \value GuiThread QQuickCLItem::eventCompleted() is called on the gui/main
+    thread.
+
+    \value RenderThread QQuickCLRunnable::eventCompletedOnRenderThread() is
+    called on the render thread during the next synchronization of the item,
+    before QQuickCLRunnable::update().
+ */
+
+/*!
+    Registers an event callback for \a event. With the default \a delivery,
+    the virtual function eventCompleted() will get invoked on the gui/main
+    thread when the event completes.
 
     This allows easy and safe asynchronous computations because the results can
     directly be exposed to QML from eventCompleted() due to it running on the
@@ -245,14 +652,32 @@ struct EventCallbackParam
     destroying the QQuickCLItem before completing the event are also handled
     gracefully.
 
+    Events completing in quick succession are delivered together: there is at
+    most one pending notification per item in the gui thread's event queue,
+    and eventCompleted() is then called for each event in order of
+    completion.
+
+    When \a delivery is RenderThread, QQuickCLRunnable::eventCompletedOnRenderThread()
+    is called instead, right before the next QQuickCLRunnable::update(). This
+    is the better choice for results that are consumed on the GPU, for example
+    by rendering with OpenGL, since it avoids the round trip via the gui
+    thread and with it a frame of latency. Completions for a runnable that
+    has been destroyed in the meantime, for example because the item was
+    removed from the window, are discarded.
+
     \note \a event is not released.
  */
-void QQuickCLItem::watchEvent(cl_event event)
+void QQuickCLItem::watchEvent(cl_event event, EventDelivery delivery)
 {
-    EventCallbackParam *param = new EventCallbackParam(this);
-    cl_int err = clSetEventCallback(event, CL_COMPLETE, QQuickCLItemPrivate::eventCallback, param);
-    if (err != CL_SUCCESS)
+    Q_D(QQuickCLItem);
+    QQuickCLEventRecord *rec = d->channel->allocate(event, delivery);
+    cl_int err = clSetEventCallback(event, CL_COMPLETE, QQuickCLItemPrivate::eventCallback, rec);
+    if (err != CL_SUCCESS) {
         qWarning("Failed to set event callback: %d", err);
+        QQuickCLEventChannel *channel = rec->channel;
+        channel->recycle(rec, rec);
+        channel->deref();
+    }
 }
 
 /*!
@@ -264,14 +689,106 @@ void QQuickCLItem::eventCompleted(cl_event event)
     Q_UNUSED(event);
 }
 
+/*!
+    \return an item that acts as a texture provider for the output with the
+    given \a index, or \c null if \a index is negative.
+
+    This allows using the results of the OpenCL computations in other items,
+    for example ShaderEffect, without rendering the QQuickCLItem into a layer
+    first. With QQuickCLImageRunnable there is one output per image set via
+    QQuickCLImageRunnable::setOutputCount().
+
+    \badcode
+        CLItem {
+            id: clItem
+            source: srcImage
+        }
+        ShaderEffect {
+            property variant mask: clItem.output(1)
+            ...
+        }
+    \endcode
+
+    The returned item is a child of this item and does not render anything
+    itself. Calling the function again with the same \a index returns the same
+    item.
+
+    \sa setOutputTexture(), textureProvider()
+ */
+QQuickItem *QQuickCLItem::output(int index)
+{
+    Q_D(QQuickCLItem);
+    if (index < 0)
+        return 0;
+    if (d->outputItems.count() <= index)
+        d->outputItems.resize(index + 1);
+    if (!d->outputItems[index])
+        d->outputItems[index] = new QQuickCLItemOutput(this, index);
+    return d->outputItems[index];
+}
+
+/*!
+    Sets the texture exposed for the output with the given \a index to \a
+    texture.
+
+    QQuickCLImageRunnable calls this function automatically whenever a new
+    result is shown. Custom QQuickCLRunnable implementations producing
+    textures can call it from QQuickCLRunnable::update() to make them
+    available via output(). The texture must stay valid until it is replaced,
+    or until the runnable is destroyed.
+
+    \note This function must be called on the render thread.
+ */
+void QQuickCLItem::setOutputTexture(QSGTexture *texture, int index)
+{
+    Q_D(QQuickCLItem);
+    if (index >= 0)
+        d->renderState->setOutputTexture(texture, index);
+}
+
+/*!
+    \return \c true, a QQuickCLItem can always act as a texture provider.
+
+    \sa textureProvider()
+ */
+bool QQuickCLItem::isTextureProvider() const
+{
+    return true;
+}
+
+/*!
+    \return the texture provider for the first output, unless the item is
+    rendered into a layer, in which case the layer's provider is returned.
+
+    This allows passing the item directly to ShaderEffect or to another
+    QQuickCLItem as a source, without wrapping it into a layer and paying for
+    an extra render pass. The result is the same as using \c{output(0)}.
+
+    \note This function must be called on the render thread.
+
+    \sa output()
+ */
+QSGTextureProvider *QQuickCLItem::textureProvider() const
+{
+    // When layer.enabled is set, the base class provides the layer texture.
+    if (QQuickItem::isTextureProvider())
+        return QQuickItem::textureProvider();
+
+    Q_D(const QQuickCLItem);
+    return d->renderState->provider(0);
+}
+
 void CL_CALLBACK QQuickCLItemPrivate::eventCallback(cl_event event, cl_int status, void *user_data)
 {
-    if (status != CL_COMPLETE)
-        return;
-    EventCallbackParam *param = static_cast<EventCallbackParam *>(user_data);
-    if (!param->item.isNull())
-        QCoreApplication::postEvent(param->item, new EventCompleteEvent(event));
-    delete param;
+    Q_UNUSED(event);
+    QQuickCLEventRecord *rec = static_cast<QQuickCLEventRecord *>(user_data);
+    QQuickCLEventChannel *channel = rec->channel;
+    if (status == CL_COMPLETE) {
+        channel->push(rec);
+    } else {
+        channel->recycle(rec, rec);
+    }
+    channel->deref();
 }
 
 QQuickCLRunnable::~QQuickCLRunnable()
@@ -45,23 +45,52 @@ QT_BEGIN_NAMESPACE
 
 class QQuickCLItemPrivate;
 class QQuickCLContext;
+class QSGTexture;
+class QSGTextureProvider;
 
 class Q_QUICKCL_EXPORT QQuickCLItem : public QQuickItem
 {
     Q_OBJECT
     Q_DECLARE_PRIVATE(QQuickCLItem)
+    Q_PROPERTY(qreal maximumComputeRate READ maximumComputeRate WRITE setMaximumComputeRate NOTIFY maximumComputeRateChanged)
+    Q_PROPERTY(qreal computeBudget READ computeBudget WRITE setComputeBudget NOTIFY computeBudgetChanged)
 
 public:
+    enum EventDelivery {
+        GuiThread,
+        RenderThread
+    };
+
     QQuickCLItem(QQuickItem *parent = 0);
+    ~QQuickCLItem();
 
     QQuickCLContext *context() const;
 
     void scheduleUpdate();
+    void scheduleUpdate(int delay);
+
+    qreal maximumComputeRate() const;
+    void setMaximumComputeRate(qreal rate);
 
-    void watchEvent(cl_event event);
+    qreal computeBudget() const;
+    void setComputeBudget(qreal budget);
+
+    void watchEvent(cl_event event, EventDelivery delivery = GuiThread);
     virtual void eventCompleted(cl_event event);
 
+    Q_INVOKABLE QQuickItem *output(int index);
+    void setOutputTexture(QSGTexture *texture, int index = 0);
+
+    bool isTextureProvider() const Q_DECL_OVERRIDE;
+    QSGTextureProvider *textureProvider() const Q_DECL_OVERRIDE;
+
+signals:
+    void maximumComputeRateChanged();
+    void computeBudgetChanged();
+
 protected:
+    QQuickCLItem(QQuickCLItemPrivate &dd, QQuickItem *parent);
+
     virtual QQuickCLRunnable *createCL() = 0;
 
 private slots:
@@ -71,6 +100,7 @@ private:
     QSGNode *updatePaintNode(QSGNode *, UpdatePaintNodeData *) Q_DECL_OVERRIDE;
     void releaseResources() Q_DECL_OVERRIDE;
     bool event(QEvent *) Q_DECL_OVERRIDE;
+    void timerEvent(QTimerEvent *) Q_DECL_OVERRIDE;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,182 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLITEM_P_H
+#define QQUICKCLITEM_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qquickclitem.h"
+#include <QtQuick/private/qquickitem_p.h>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QQuickCLEventChannel;
+class QQuickCLTextureProvider;
+class QQuickCLItemRenderState;
+class QQuickCLItemOutput;
+
+struct QQuickCLEventRecord
+{
+    QQuickCLEventRecord *next;
+    cl_event event;
+    QQuickCLEventChannel *channel;
+    QQuickCLItem::EventDelivery delivery;
+};
+
+// Connects OpenCL event callbacks and other threads with an item. Reference
+// counted since callbacks may arrive after the item is gone. Completed events
+// are pushed onto a lock-free stack by the callbacks (multiple producers) and
+// taken in one go on the gui or render thread (single consumer per stack).
+// Only the transition from empty to non-empty posts an event or schedules an
+// update, so there is at most one pending notification per item and stack.
+// Records are pooled to avoid an allocation per watched event.
+//
+// Code running on threads that do not synchronize with the item's lifetime,
+// for example program builds, holds a reference acquired via acquire() and
+// uses scheduleUpdate() or scheduleWindowUpdate() instead of calling the
+// item or its window directly.
+class QQuickCLEventChannel
+{
+public:
+    QQuickCLEventChannel(QQuickCLItem *item) : ref(1), item(item), pool(0) { }
+    ~QQuickCLEventChannel();
+
+    // Returns the channel of item with an additional reference. Must be called
+    // on the gui thread, or on the render thread while the gui thread is blocked.
+    static QQuickCLEventChannel *acquire(QQuickCLItem *item);
+    void deref() { if (!ref.deref()) delete this; }
+
+    void scheduleUpdate();
+    void scheduleWindowUpdate();
+
+    QQuickCLEventRecord *allocate(cl_event event, QQuickCLItem::EventDelivery delivery);
+    void recycle(QQuickCLEventRecord *first, QQuickCLEventRecord *last);
+    void push(QQuickCLEventRecord *rec);
+    QQuickCLEventRecord *take(QQuickCLItem::EventDelivery delivery, QQuickCLEventRecord **last);
+
+    QAtomicInt ref;
+    QMutex itemMutex;
+    QQuickCLItem *item;
+    QAtomicPointer<QQuickCLEventRecord> completed[2]; // indexed by EventDelivery
+    QMutex poolMutex;
+    QQuickCLEventRecord *pool;
+};
+
+// Schedules an update of the item whenever a texture provider it reads from
+// signals a change, for example a new result of another QQuickCLItem. Lives
+// on the render thread.
+class QQuickCLSourceWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    QQuickCLSourceWatcher(QQuickCLEventChannel *channel) : channel(channel) { channel->ref.ref(); }
+    ~QQuickCLSourceWatcher() { channel->deref(); }
+
+private slots:
+    void sourceChanged() { channel->scheduleUpdate(); }
+
+private:
+    QQuickCLEventChannel *channel;
+};
+
+// The texture providers exposing the item's outputs and the textures they
+// provide. Providers are created, updated and deleted on the render thread
+// only, also from code that runs while the gui thread is not blocked, so the
+// state is reference counted instead of being owned by the item. The item
+// hands its reference to a render job when destroyed.
+class QQuickCLItemRenderState
+{
+public:
+    QQuickCLItemRenderState() : ref(1) { }
+    ~QQuickCLItemRenderState();
+
+    // Returns the state of item with an additional reference. Must be called
+    // on the gui thread, or on the render thread while the gui thread is blocked.
+    static QQuickCLItemRenderState *acquire(QQuickCLItem *item);
+    void deref() { if (!ref.deref()) delete this; }
+
+    QQuickCLTextureProvider *provider(int index);
+    void setOutputTexture(QSGTexture *texture, int index, bool contentChanged = false);
+    void releaseProviders();
+
+    QAtomicInt ref;
+    QVector<QQuickCLTextureProvider *> providers;
+    QVector<QSGTexture *> outputTextures;
+};
+
+class QQuickCLItemPrivate : public QQuickItemPrivate
+{
+    Q_DECLARE_PUBLIC(QQuickCLItem)
+
+public:
+    QQuickCLItemPrivate() : clctx(0), clnode(0), channel(0), renderState(0), maximumComputeRate(0), computeBudget(0) { }
+
+    static QQuickCLItemPrivate *get(QQuickCLItem *item) { return item->d_func(); }
+
+    static void CL_CALLBACK eventCallback(cl_event event, cl_int status, void *user_data);
+    void deliverRenderThreadEvents();
+
+    QQuickCLContext *clctx;
+    QQuickCLRunnable *clnode;
+    QQuickCLEventChannel *channel;
+    QQuickCLItemRenderState *renderState;
+    QAtomicInt updatePending;
+    QAtomicInt delayedUpdatePending; // set until delayedUpdate fires
+    QBasicTimer delayedUpdate;
+    qreal maximumComputeRate;
+    qreal computeBudget;
+    QVector<QQuickCLItemOutput *> outputItems; // gui thread
+};
+
+QT_END_NAMESPACE
+
+#endif
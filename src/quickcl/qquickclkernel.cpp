@@ -0,0 +1,488 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickclkernel.h"
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QVarLengthArray>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(logCL)
+
+/*!
+    \class QQuickCLKernel
+
+    \brief QQuickCLKernel wraps an OpenCL kernel object and takes care of
+    setting arguments and enqueuing it.
+
+    Instead of a series of \c clSetKernelArg() calls followed by \c
+    clEnqueueNDRangeKernel(), all with unchecked return values, kernels can be
+    launched with a single call to enqueue():
+
+    \code
+        QQuickCLKernel m_kernel;
+        ...
+        m_kernel.create(program, "Emboss");
+        ...
+        m_kernel.enqueue(commandQueue(), QQuickCLKernel::Range(size), inImage, outImage, factor);
+    \endcode
+
+    The arguments are checked at compile time: only plain data types, for
+    example \c cl_float or \c cl_float4, and OpenCL objects like \c cl_mem
+    are accepted. Local memory is reserved by passing a LocalMemory instance.
+    At runtime the number of arguments is checked against the kernel, and
+    failures are reported with the name of the kernel.
+
+    Pass values of the exact OpenCL type, for example \c cl_float(2) instead
+    of the literal \c 2 for a \c float parameter. A plain \c int has the same
+    size as a \c float and would otherwise be reinterpreted by the kernel.
+
+    Argument values are cached: \c clSetKernelArg() is only called for
+    arguments whose value changed since the previous dispatch. This reduces
+    the number of driver calls per frame for kernels with many parameters that
+    rarely change. Setting an unchanged value does not allocate memory.
+
+    Argument names, types and address qualifiers are queried once via \c
+    clGetKernelArgInfo() when OpenCL 1.2 is available. They are used to
+    report values of the wrong size, values whose OpenCL type does not match
+    the parameter, for example a \c cl_int for a \c float, and local memory
+    arguments not set via LocalMemory, with the name of the argument. Some implementations only
+    provide this information for programs built with the \c{-cl-kernel-arg-info}
+    option, the checks are skipped otherwise.
+
+    \note The variadic functions are only available when the compiler supports
+    variadic templates. Otherwise use setArgument() and dispatch().
+
+    \note Like the underlying kernel object, QQuickCLKernel is not thread-safe.
+ */
+
+/*!
+    \class QQuickCLKernel::Range
+    \brief Describes the global and, optionally, the local work size of a
+    kernel dispatch.
+ */
+
+/*!
+    \class QQuickCLKernel::LocalMemory
+    \brief Reserves local memory of a given size for a \c local pointer
+    argument of a kernel.
+ */
+
+struct QQuickCLKernelArgument
+{
+    enum Kind {
+        Unknown,
+        Value,
+        Local
+    };
+
+    QQuickCLKernelArgument() : kind(Unknown), expectedSize(0), typeChecked(false), set(false), local(false), size(0) { }
+
+    QByteArray name;
+    QByteArray typeName;
+    Kind kind;
+    size_t expectedSize; // 0 when not known
+    bool typeChecked;
+    bool set;
+    bool local;
+    size_t size;
+    QVarLengthArray<char, 16> value; // large enough for most values without allocating
+};
+
+class QQuickCLKernelPrivate
+{
+public:
+    QQuickCLKernelPrivate() : kernel(0) { }
+
+    QByteArray argumentName(int index) const {
+        return args[index].name.isEmpty() ? QByteArray::number(index) : args[index].name;
+    }
+
+    cl_kernel kernel;
+    QByteArray name;
+    QVector<QQuickCLKernelArgument> args;
+};
+
+#ifdef CL_VERSION_1_2
+// Returns the size of a value of the given OpenCL C type, or 0 if not known,
+// for example for structs.
+static size_t argumentSize(const QByteArray &typeName)
+{
+    if (typeName.endsWith('*') || typeName.startsWith("image"))
+        return sizeof(cl_mem);
+    if (typeName == "sampler_t")
+        return sizeof(cl_sampler);
+
+    static const struct {
+        const char *name;
+        size_t size;
+    } scalarTypes[] = {
+        { "char", 1 }, { "uchar", 1 }, { "short", 2 }, { "ushort", 2 },
+        { "int", 4 }, { "uint", 4 }, { "long", 8 }, { "ulong", 8 },
+        { "half", 2 }, { "float", 4 }, { "double", 8 }
+    };
+    int baseLength = typeName.size();
+    while (baseLength > 0 && typeName.at(baseLength - 1) >= '0' && typeName.at(baseLength - 1) <= '9')
+        --baseLength;
+    int width = baseLength < typeName.size() ? typeName.mid(baseLength).toInt() : 1;
+    if (width == 3) // 3-component vectors have the size of 4-component ones
+        width = 4;
+    const QByteArray base = typeName.left(baseLength);
+    for (size_t i = 0; i < sizeof(scalarTypes) / sizeof(scalarTypes[0]); ++i) {
+        if (base == scalarTypes[i].name)
+            return scalarTypes[i].size * width;
+    }
+    return 0;
+}
+#endif
+
+// Returns true when a value of the host type \a hostType, as provided by
+// QQuickCLKernelArgumentType, can be passed for a parameter of the OpenCL C
+// type \a typeName.
+static bool argumentTypeMatches(QByteArray typeName, const QByteArray &hostType)
+{
+    if (hostType == "cl_mem")
+        return typeName.endsWith('*') || typeName.startsWith("image");
+    if (typeName.startsWith("unsigned "))
+        typeName = 'u' + typeName.mid(9);
+    if (typeName == hostType)
+        return true;
+    // 3-component vectors are passed as cl_type4, cl_type3 is only a typedef.
+    if (typeName.endsWith('3'))
+        return typeName.left(typeName.size() - 1) + '4' == hostType;
+    // cl_half is the same type as cl_ushort.
+    return typeName == "half" && hostType == "ushort";
+}
+
+/*!
+    Constructs an invalid instance. Call create() to get a kernel.
+ */
+QQuickCLKernel::QQuickCLKernel()
+    : d_ptr(new QQuickCLKernelPrivate)
+{
+}
+
+/*!
+    Constructs an instance and creates the kernel called \a name from \a
+    program.
+ */
+QQuickCLKernel::QQuickCLKernel(cl_program program, const char *name)
+    : d_ptr(new QQuickCLKernelPrivate)
+{
+    create(program, name);
+}
+
+/*!
+    Destroys the instance and releases the kernel.
+ */
+QQuickCLKernel::~QQuickCLKernel()
+{
+    destroy();
+    delete d_ptr;
+}
+
+/*!
+    Creates the kernel called \a name from \a program. If a kernel was already
+    created, it is released first.
+
+    \return \c true if successful. Failures are printed to the warning output.
+ */
+bool QQuickCLKernel::create(cl_program program, const char *name)
+{
+    Q_D(QQuickCLKernel);
+    destroy();
+
+    if (!program)
+        return false;
+
+    cl_int err;
+    d->kernel = clCreateKernel(program, name, &err);
+    if (!d->kernel) {
+        qWarning("Failed to create OpenCL kernel %s: %d", name, err);
+        return false;
+    }
+    d->name = name;
+
+    cl_uint argCount = 0;
+    clGetKernelInfo(d->kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &argCount, 0);
+    d->args.resize(argCount);
+
+#ifdef CL_VERSION_1_2
+    for (cl_uint i = 0; i < argCount; ++i) {
+        QQuickCLKernelArgument &arg(d->args[i]);
+        QByteArray s(256, '\0');
+        if (clGetKernelArgInfo(d->kernel, i, CL_KERNEL_ARG_NAME, s.size(), s.data(), 0) != CL_SUCCESS)
+            break; // not available, for example because the platform is OpenCL 1.1
+        arg.name = QByteArray(s.constData());
+        if (clGetKernelArgInfo(d->kernel, i, CL_KERNEL_ARG_TYPE_NAME, s.size(), s.data(), 0) == CL_SUCCESS)
+            arg.typeName = QByteArray(s.constData());
+        cl_kernel_arg_address_qualifier qualifier;
+        if (clGetKernelArgInfo(d->kernel, i, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(qualifier), &qualifier, 0) == CL_SUCCESS) {
+            if (qualifier == CL_KERNEL_ARG_ADDRESS_LOCAL) {
+                arg.kind = QQuickCLKernelArgument::Local;
+            } else {
+                arg.kind = QQuickCLKernelArgument::Value;
+                arg.expectedSize = argumentSize(arg.typeName);
+            }
+        }
+    }
+#endif
+
+    qCDebug(logCL, "Created kernel %s with %u arguments", name, argCount);
+    return true;
+}
+
+/*!
+    Releases the kernel.
+ */
+void QQuickCLKernel::destroy()
+{
+    Q_D(QQuickCLKernel);
+    if (d->kernel) {
+        clReleaseKernel(d->kernel);
+        d->kernel = 0;
+    }
+    d->name.clear();
+    d->args.clear();
+}
+
+/*!
+    \return \c true if the kernel was created successfully.
+ */
+bool QQuickCLKernel::isValid() const
+{
+    Q_D(const QQuickCLKernel);
+    return d->kernel != 0;
+}
+
+/*!
+    \return the underlying kernel object.
+
+    \note Calling \c clSetKernelArg() directly on the returned kernel
+    invalidates the argument cache. Use setArgumentData() instead.
+ */
+cl_kernel QQuickCLKernel::kernel() const
+{
+    Q_D(const QQuickCLKernel);
+    return d->kernel;
+}
+
+/*!
+    \return the name of the kernel function.
+ */
+QByteArray QQuickCLKernel::name() const
+{
+    Q_D(const QQuickCLKernel);
+    return d->name;
+}
+
+/*!
+    \return the number of arguments the kernel function takes.
+ */
+int QQuickCLKernel::argumentCount() const
+{
+    Q_D(const QQuickCLKernel);
+    return d->args.count();
+}
+
+/*!
+    \return the name of the argument at \a index or an empty array when the
+    information is not available.
+ */
+QByteArray QQuickCLKernel::argumentName(int index) const
+{
+    Q_D(const QQuickCLKernel);
+    return index >= 0 && index < d->args.count() ? d->args[index].name : QByteArray();
+}
+
+/*!
+    \return the type name of the argument at \a index or an empty array when
+    the information is not available.
+ */
+QByteArray QQuickCLKernel::argumentTypeName(int index) const
+{
+    Q_D(const QQuickCLKernel);
+    return index >= 0 && index < d->args.count() ? d->args[index].typeName : QByteArray();
+}
+
+/*!
+    Sets the argument at \a index to the \a size bytes at \a data. When the
+    argument was already set to the same value, \c clSetKernelArg() is not
+    called.
+
+    \return \c true if successful.
+ */
+bool QQuickCLKernel::setArgumentData(int index, const void *data, size_t size)
+{
+    Q_D(QQuickCLKernel);
+    if (index < 0 || index >= d->args.count()) {
+        qWarning("Kernel %s: argument index %d out of range", d->name.constData(), index);
+        return false;
+    }
+
+    QQuickCLKernelArgument &arg(d->args[index]);
+    const bool local = !data;
+    // Local memory arguments are cached by their size alone.
+    if (arg.set && arg.local == local && arg.size == size && (local || !memcmp(arg.value.constData(), data, size)))
+        return true;
+
+    if (arg.kind == QQuickCLKernelArgument::Local && !local) {
+        qWarning("Kernel %s: argument %s is a local memory pointer, use LocalMemory",
+                 d->name.constData(), d->argumentName(index).constData());
+        return false;
+    }
+    if (arg.kind == QQuickCLKernelArgument::Value && local) {
+        qWarning("Kernel %s: argument %s does not take local memory",
+                 d->name.constData(), d->argumentName(index).constData());
+        return false;
+    }
+    if (arg.expectedSize && size != arg.expectedSize) {
+        qWarning("Kernel %s: argument %s of type %s takes %u bytes, got %u",
+                 d->name.constData(), d->argumentName(index).constData(), arg.typeName.constData(),
+                 uint(arg.expectedSize), uint(size));
+        return false;
+    }
+
+    cl_int err = clSetKernelArg(d->kernel, index, size, data);
+    if (err != CL_SUCCESS) {
+        qWarning("Kernel %s: failed to set argument %s (size %u): %d",
+                 d->name.constData(), d->argumentName(index).constData(), uint(size), err);
+        arg.set = false;
+        return false;
+    }
+    arg.set = true;
+    arg.local = local;
+    arg.size = size;
+    if (!local) {
+        arg.value.resize(int(size)); // only allocates for values larger than before
+        memcpy(arg.value.data(), data, size);
+    }
+    return true;
+}
+
+/*!
+    Reserves \a mem.size bytes of local memory for the argument at \a index.
+ */
+bool QQuickCLKernel::setArgument(int index, const LocalMemory &mem)
+{
+    return setArgumentData(index, 0, mem.size);
+}
+
+void QQuickCLKernel::checkArgumentType(int index, const char *typeName)
+{
+    Q_D(QQuickCLKernel);
+    if (index < 0 || index >= d->args.count())
+        return; // reported by setArgumentData()
+    QQuickCLKernelArgument &arg(d->args[index]);
+    // Only builtin types are known to argumentSize(), typedefs and structs
+    // declared in the program cannot be compared.
+    if (arg.typeChecked || !typeName || !arg.expectedSize)
+        return;
+    arg.typeChecked = true; // warn once per argument
+    if (!argumentTypeMatches(arg.typeName, QByteArray(typeName)))
+        qWarning("Kernel %s: argument %s of type %s set from a value of type %s",
+                 d->name.constData(), d->argumentName(index).constData(), arg.typeName.constData(),
+                 typeName);
+}
+
+bool QQuickCLKernel::checkArgumentCount(int count) const
+{
+    Q_D(const QQuickCLKernel);
+    if (!d->kernel) {
+        qWarning("Attempted to use an invalid kernel");
+        return false;
+    }
+    if (count != d->args.count()) {
+        qWarning("Kernel %s takes %d arguments, got %d", d->name.constData(), d->args.count(), count);
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Enqueues the kernel on \a queue with the work sizes specified in \a range
+    and the arguments set via setArgument() or setArguments(). The command
+    waits for the events in \a waitList. When \a event is not null, it
+    receives an event for the command.
+
+    \return the result of \c clEnqueueNDRangeKernel(). Failures are printed to
+    the warning output.
+ */
+cl_int QQuickCLKernel::dispatch(cl_command_queue queue, const Range &range,
+                                const QVector<cl_event> &waitList, cl_event *event)
+{
+    Q_D(QQuickCLKernel);
+    if (!d->kernel) {
+        qWarning("Attempted to enqueue an invalid kernel");
+        return CL_INVALID_KERNEL;
+    }
+    cl_int err = clEnqueueNDRangeKernel(queue, d->kernel, range.dimensions, 0, range.global,
+                                        range.hasLocal ? range.local : 0,
+                                        waitList.count(), waitList.isEmpty() ? 0 : waitList.constData(),
+                                        event);
+    if (err != CL_SUCCESS)
+        qWarning("Failed to enqueue kernel %s: %d", d->name.constData(), err);
+    return err;
+}
+
+/*!
+    \fn bool QQuickCLKernel::setArgument(int index, const T &value)
+
+    Sets the argument at \a index to \a value. \c T must be a plain data type
+    or an OpenCL object type like \c cl_mem. When the kernel's argument
+    information is available, a warning is printed once if \c T does not
+    match the parameter's type, for example \c cl_int for a \c float.
+ */
+
+/*!
+    \fn bool QQuickCLKernel::setArguments(const Args &... args)
+
+    Sets all arguments of the kernel to \a args. The number of arguments must
+    match the kernel function's parameter list.
+ */
+
+/*!
+    \fn cl_int QQuickCLKernel::enqueue(cl_command_queue queue, const Range &range, const Args &... args)
+
+    Sets the kernel arguments to \a args and enqueues the kernel on \a queue
+    with the work sizes given in \a range.
+
+    \return the result of \c clEnqueueNDRangeKernel() or \c
+    CL_INVALID_KERNEL_ARGS when the arguments could not be set.
+ */
+
+QT_END_NAMESPACE
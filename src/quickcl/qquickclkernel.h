@@ -0,0 +1,188 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLKERNEL_H
+#define QQUICKCLKERNEL_H
+
+#include <QtQuickCL/qtquickclglobal.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qsize.h>
+#include <QtCore/qvector.h>
+
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+#include <type_traits>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+class QQuickCLKernelPrivate;
+
+// Maps host types to the OpenCL C type names reported for kernel arguments.
+// Types without a mapping, for example structs, are not checked.
+template <typename T>
+struct QQuickCLKernelArgumentType
+{
+    static const char *name() { return 0; }
+};
+
+#define Q_QUICKCL_ARGUMENT_TYPE(T, N) \
+    template <> struct QQuickCLKernelArgumentType<T> { static const char *name() { return N; } };
+#define Q_QUICKCL_ARGUMENT_TYPES(T, N) \
+    Q_QUICKCL_ARGUMENT_TYPE(T, N) \
+    Q_QUICKCL_ARGUMENT_TYPE(T##2, N "2") \
+    Q_QUICKCL_ARGUMENT_TYPE(T##4, N "4") \
+    Q_QUICKCL_ARGUMENT_TYPE(T##8, N "8") \
+    Q_QUICKCL_ARGUMENT_TYPE(T##16, N "16")
+
+Q_QUICKCL_ARGUMENT_TYPES(cl_char, "char")
+Q_QUICKCL_ARGUMENT_TYPES(cl_uchar, "uchar")
+Q_QUICKCL_ARGUMENT_TYPES(cl_short, "short")
+Q_QUICKCL_ARGUMENT_TYPES(cl_ushort, "ushort")
+Q_QUICKCL_ARGUMENT_TYPES(cl_int, "int")
+Q_QUICKCL_ARGUMENT_TYPES(cl_uint, "uint")
+Q_QUICKCL_ARGUMENT_TYPES(cl_long, "long")
+Q_QUICKCL_ARGUMENT_TYPES(cl_ulong, "ulong")
+Q_QUICKCL_ARGUMENT_TYPES(cl_float, "float")
+Q_QUICKCL_ARGUMENT_TYPES(cl_double, "double")
+Q_QUICKCL_ARGUMENT_TYPE(cl_mem, "cl_mem")
+Q_QUICKCL_ARGUMENT_TYPE(cl_sampler, "sampler_t")
+
+#undef Q_QUICKCL_ARGUMENT_TYPES
+#undef Q_QUICKCL_ARGUMENT_TYPE
+
+class Q_QUICKCL_EXPORT QQuickCLKernel
+{
+    Q_DECLARE_PRIVATE(QQuickCLKernel)
+
+public:
+    struct LocalMemory
+    {
+        explicit LocalMemory(size_t size) : size(size) { }
+        size_t size;
+    };
+
+    class Range
+    {
+    public:
+        Range(size_t x) : dimensions(1), hasLocal(false) { set(global, x, 1, 1); }
+        Range(size_t x, size_t y) : dimensions(2), hasLocal(false) { set(global, x, y, 1); }
+        Range(size_t x, size_t y, size_t z) : dimensions(3), hasLocal(false) { set(global, x, y, z); }
+        Range(const QSize &size) : dimensions(2), hasLocal(false) { set(global, size.width(), size.height(), 1); }
+
+        Range &setLocal(size_t x, size_t y = 1, size_t z = 1) { set(local, x, y, z); hasLocal = true; return *this; }
+
+        cl_uint dimensions;
+        size_t global[3];
+        size_t local[3];
+        bool hasLocal;
+
+    private:
+        static void set(size_t *v, size_t x, size_t y, size_t z) { v[0] = x; v[1] = y; v[2] = z; }
+    };
+
+    QQuickCLKernel();
+    QQuickCLKernel(cl_program program, const char *name);
+    ~QQuickCLKernel();
+
+    bool create(cl_program program, const char *name);
+    void destroy();
+
+    bool isValid() const;
+    cl_kernel kernel() const;
+    QByteArray name() const;
+
+    int argumentCount() const;
+    QByteArray argumentName(int index) const;
+    QByteArray argumentTypeName(int index) const;
+
+    bool setArgumentData(int index, const void *data, size_t size);
+    bool setArgument(int index, const LocalMemory &mem);
+
+    cl_int dispatch(cl_command_queue queue, const Range &range,
+                    const QVector<cl_event> &waitList = QVector<cl_event>(), cl_event *event = 0);
+
+    template <typename T>
+    bool setArgument(int index, const T &value)
+    {
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+        Q_STATIC_ASSERT_X(std::is_pod<T>::value, "Kernel arguments must be plain data types");
+        Q_STATIC_ASSERT_X(!std::is_pointer<T>::value
+                          || std::is_same<T, cl_mem>::value || std::is_same<T, cl_sampler>::value,
+                          "Pointers cannot be passed to kernels, use cl_mem instead");
+#endif
+        checkArgumentType(index, QQuickCLKernelArgumentType<T>::name());
+        return setArgumentData(index, &value, sizeof(T));
+    }
+
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+    template <typename... Args>
+    bool setArguments(const Args &... args)
+    {
+        if (!checkArgumentCount(int(sizeof...(Args))))
+            return false;
+        return setArgumentsFrom(0, args...);
+    }
+
+    template <typename... Args>
+    cl_int enqueue(cl_command_queue queue, const Range &range, const Args &... args)
+    {
+        if (!setArguments(args...))
+            return CL_INVALID_KERNEL_ARGS;
+        return dispatch(queue, range);
+    }
+
+private:
+    bool setArgumentsFrom(int) { return true; }
+
+    template <typename T, typename... Rest>
+    bool setArgumentsFrom(int index, const T &value, const Rest &... rest)
+    {
+        const bool ok = setArgument(index, value);
+        return setArgumentsFrom(index + 1, rest...) && ok;
+    }
+#endif
+
+private:
+    bool checkArgumentCount(int count) const;
+    void checkArgumentType(int index, const char *typeName);
+
+    Q_DISABLE_COPY(QQuickCLKernel)
+    QQuickCLKernelPrivate *d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif
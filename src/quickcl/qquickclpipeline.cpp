@@ -0,0 +1,1064 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickclpipeline.h"
+#include "qquickclimagerunnable.h"
+#include "qquickclcontext.h"
+#include "qquickclkernel.h"
+#include "qquickclitem_p.h"
+#include <QtCore/private/qobject_p.h>
+#include <QtGui/QColor>
+#include <QtGui/QVector2D>
+#include <QtGui/QVector3D>
+#include <QtGui/QVector4D>
+#include <QtCore/QHash>
+#include <QtCore/QLoggingCategory>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(logCL)
+
+/*!
+    \class QQuickCLStage
+    \brief One kernel invocation in a QQuickCLPipeline.
+
+    A stage runs the kernel named by \l kernel over an image of its own. The
+    kernel receives the images listed in \l inputs, followed by the stage's
+    output image, followed by the values in \l arguments:
+
+    \badcode
+        __kernel void blurX(__read_only image2d_t src, __write_only image2d_t dst, float radius)
+    \endcode
+
+    Inputs refer to the outputs of other stages by name. The special name \c
+    source stands for the texture of the pipeline's
+    \l{QQuickCLPipeline::source}{source} item.
+ */
+
+/*!
+    \property QQuickCLStage::kernel
+
+    The name of the kernel function in the pipeline's
+    \l{QQuickCLPipeline::program}{program}.
+ */
+
+/*!
+    \property QQuickCLStage::inputs
+
+    The names of the images read by the stage, in the order of the kernel's
+    parameters. Each name is either \c source or the \l output of another
+    stage.
+ */
+
+/*!
+    \property QQuickCLStage::output
+
+    The name of the image written by the stage. Names must be unique within a
+    pipeline and must not be \c source.
+ */
+
+/*!
+    \property QQuickCLStage::format
+
+    The format of the output image. The default is \c RGBA8. See
+    QQuickCLImageRunnable::setOutputFormat() for the supported values.
+ */
+
+/*!
+    \property QQuickCLStage::scale
+
+    The size of the output image relative to the size of the pipeline's source.
+    The default is 1. For example, a downsampling pass for a bloom effect
+    would use 0.5.
+ */
+
+/*!
+    \property QQuickCLStage::arguments
+
+    Additional kernel arguments following the output image. Each value is
+    converted to the type of the kernel parameter it is passed for: numbers
+    and booleans to scalar types, for example \c float or \c uint, and
+    points, sizes, colors, \c{Qt.vector3d()} and similar values, or arrays of
+    numbers to vector types with the same number of components, for example
+    \c float2 or \c float4.
+
+    The parameter types are queried via \c clGetKernelArgInfo(), which
+    requires OpenCL 1.2. Otherwise the type is derived from the value:
+    integers and booleans are passed as \c int, other numbers as \c float,
+    points and sizes as \c float2 and colors as \c float4. Since QML stores
+    whole numbers, including \c{2.0}, as integers, \c float parameters then
+    need values with a fractional part.
+ */
+
+class QQuickCLStagePrivate : public QObjectPrivate
+{
+public:
+    QQuickCLStagePrivate() : format(QQuickCLStage::RGBA8), scale(1) { }
+
+    QString kernel;
+    QStringList inputs;
+    QString output;
+    QQuickCLStage::Format format;
+    qreal scale;
+    QVariantList arguments;
+};
+
+QQuickCLStage::QQuickCLStage(QObject *parent)
+    : QObject(*new QQuickCLStagePrivate, parent)
+{
+}
+
+QString QQuickCLStage::kernel() const
+{
+    Q_D(const QQuickCLStage);
+    return d->kernel;
+}
+
+void QQuickCLStage::setKernel(const QString &kernel)
+{
+    Q_D(QQuickCLStage);
+    if (d->kernel != kernel) {
+        d->kernel = kernel;
+        emit kernelChanged();
+        emit changed();
+    }
+}
+
+QStringList QQuickCLStage::inputs() const
+{
+    Q_D(const QQuickCLStage);
+    return d->inputs;
+}
+
+void QQuickCLStage::setInputs(const QStringList &inputs)
+{
+    Q_D(QQuickCLStage);
+    if (d->inputs != inputs) {
+        d->inputs = inputs;
+        emit inputsChanged();
+        emit changed();
+    }
+}
+
+QString QQuickCLStage::output() const
+{
+    Q_D(const QQuickCLStage);
+    return d->output;
+}
+
+void QQuickCLStage::setOutput(const QString &output)
+{
+    Q_D(QQuickCLStage);
+    if (d->output != output) {
+        d->output = output;
+        emit outputChanged();
+        emit changed();
+    }
+}
+
+QQuickCLStage::Format QQuickCLStage::format() const
+{
+    Q_D(const QQuickCLStage);
+    return d->format;
+}
+
+void QQuickCLStage::setFormat(Format format)
+{
+    Q_D(QQuickCLStage);
+    if (d->format != format) {
+        d->format = format;
+        emit formatChanged();
+        emit changed();
+    }
+}
+
+qreal QQuickCLStage::scale() const
+{
+    Q_D(const QQuickCLStage);
+    return d->scale;
+}
+
+void QQuickCLStage::setScale(qreal scale)
+{
+    Q_D(QQuickCLStage);
+    if (d->scale != scale) {
+        d->scale = scale;
+        emit scaleChanged();
+        emit changed();
+    }
+}
+
+QVariantList QQuickCLStage::arguments() const
+{
+    Q_D(const QQuickCLStage);
+    return d->arguments;
+}
+
+void QQuickCLStage::setArguments(const QVariantList &arguments)
+{
+    Q_D(QQuickCLStage);
+    if (d->arguments != arguments) {
+        d->arguments = arguments;
+        emit argumentsChanged();
+        emit changed();
+    }
+}
+
+/*!
+    \class QQuickCLPipeline
+    \brief A QQuickCLItem running a chain of kernels declared in QML.
+
+    Multi-pass effects, for example blurs or bloom, consist of several kernels
+    where each pass reads the results of earlier ones. Instead of implementing
+    a QQuickCLRunnable managing every intermediate image, the passes can be
+    declared as QQuickCLStage objects:
+
+    \badcode
+        CLPipeline {
+            source: srcImage
+            program: "..." // OpenCL C source containing all the kernels
+            CLStage { kernel: "threshold"; inputs: ["source"]; output: "bright"; scale: 0.5 }
+            CLStage { kernel: "blurX"; inputs: ["bright"]; output: "blurX1"; scale: 0.5 }
+            CLStage { kernel: "blurY"; inputs: ["blurX1"]; output: "blurY1"; scale: 0.5 }
+            CLStage { kernel: "blurX"; inputs: ["blurY1"]; output: "blurX2"; scale: 0.5 }
+            CLStage { kernel: "blurY"; inputs: ["blurX2"]; output: "bloom"; scale: 0.5 }
+            CLStage { kernel: "combine"; inputs: ["source", "bloom"]; output: "result" }
+        }
+    \endcode
+
+    The pipeline derives the order of the stages from their inputs and
+    outputs. Stages not contributing to the \l output are not run. The output
+    of the final stage is the item's texture, all other outputs are
+    intermediate images that exist only in OpenCL. They are taken from a
+    small pool of scratch images, and an image is reused as soon as the last
+    stage reading its previous contents has run. The chain above therefore
+    needs two scratch images instead of five. The scratch images are kept
+    until the stages, the source size or the formats change.
+
+    All stages are enqueued in one go, between a single acquire and release
+    of the OpenGL textures. The pipeline uses the \c BatchedSubmission mode
+    of QQuickCLImageRunnable, so that it is also batched with other items in
+    the window.
+
+    When the stages cannot run, for example because the program failed to
+    build, the stages form a cycle or an argument has an unsupported type, a
+    warning is printed and the item shows the source instead. When the
+    source cannot be copied to the output, because the final stage uses a
+    different format or scale, the output is cleared.
+
+    The types are not registered with QML automatically:
+
+    \code
+        qmlRegisterType<QQuickCLPipeline>("quickcl.qt.io", 1, 0, "CLPipeline");
+        qmlRegisterType<QQuickCLStage>("quickcl.qt.io", 1, 0, "CLStage");
+    \endcode
+
+    \note Scratch images are always full images. Different images sharing the
+    same memory would require \c cl_khr_image2d_from_buffer and is not done.
+ */
+
+/*!
+    \property QQuickCLPipeline::source
+
+    The texture provider item read by stages using the \c source input.
+ */
+
+/*!
+    \property QQuickCLPipeline::program
+
+    The OpenCL C source code of the kernels used by the stages. It is built
+    in the background, the source is shown until the build has finished.
+ */
+
+/*!
+    \property QQuickCLPipeline::output
+
+    The name of the stage output shown by the item. When empty, which is the
+    default, the output of the last stage is shown.
+ */
+
+/*!
+    \property QQuickCLPipeline::stages
+
+    The stages of the pipeline. This is the default property.
+ */
+
+class QQuickCLPipelinePrivate : public QQuickCLItemPrivate
+{
+    Q_DECLARE_PUBLIC(QQuickCLPipeline)
+
+public:
+    QQuickCLPipelinePrivate() : source(0) { }
+
+    static QQuickCLPipelinePrivate *get(QQuickCLPipeline *pipeline) { return pipeline->d_func(); }
+
+    QQuickItem *source;
+    QString program;
+    QString output;
+    QList<QQuickCLStage *> stages;
+};
+
+QQuickCLPipeline::QQuickCLPipeline(QQuickItem *parent)
+    : QQuickCLItem(*new QQuickCLPipelinePrivate, parent)
+{
+}
+
+QQuickItem *QQuickCLPipeline::source() const
+{
+    Q_D(const QQuickCLPipeline);
+    return d->source;
+}
+
+void QQuickCLPipeline::setSource(QQuickItem *source)
+{
+    Q_D(QQuickCLPipeline);
+    if (d->source != source) {
+        d->source = source;
+        emit sourceChanged();
+        update();
+    }
+}
+
+QString QQuickCLPipeline::program() const
+{
+    Q_D(const QQuickCLPipeline);
+    return d->program;
+}
+
+void QQuickCLPipeline::setProgram(const QString &program)
+{
+    Q_D(QQuickCLPipeline);
+    if (d->program != program) {
+        d->program = program;
+        emit programChanged();
+        update();
+    }
+}
+
+QString QQuickCLPipeline::output() const
+{
+    Q_D(const QQuickCLPipeline);
+    return d->output;
+}
+
+void QQuickCLPipeline::setOutput(const QString &output)
+{
+    Q_D(QQuickCLPipeline);
+    if (d->output != output) {
+        d->output = output;
+        emit outputChanged();
+        update();
+    }
+}
+
+QQmlListProperty<QQuickCLStage> QQuickCLPipeline::stages()
+{
+    return QQmlListProperty<QQuickCLStage>(this, 0, appendStage, stageCount, stageAt, clearStages);
+}
+
+/*!
+    \return the stages of the pipeline.
+ */
+QList<QQuickCLStage *> QQuickCLPipeline::stageList() const
+{
+    Q_D(const QQuickCLPipeline);
+    return d->stages;
+}
+
+void QQuickCLPipeline::appendStage(QQmlListProperty<QQuickCLStage> *list, QQuickCLStage *stage)
+{
+    QQuickCLPipeline *pipeline = static_cast<QQuickCLPipeline *>(list->object);
+    if (!stage)
+        return;
+    QQuickCLPipelinePrivate::get(pipeline)->stages.append(stage);
+    connect(stage, SIGNAL(changed()), pipeline, SLOT(update()));
+    pipeline->update();
+}
+
+int QQuickCLPipeline::stageCount(QQmlListProperty<QQuickCLStage> *list)
+{
+    return QQuickCLPipelinePrivate::get(static_cast<QQuickCLPipeline *>(list->object))->stages.count();
+}
+
+QQuickCLStage *QQuickCLPipeline::stageAt(QQmlListProperty<QQuickCLStage> *list, int index)
+{
+    return QQuickCLPipelinePrivate::get(static_cast<QQuickCLPipeline *>(list->object))->stages.value(index);
+}
+
+void QQuickCLPipeline::clearStages(QQmlListProperty<QQuickCLStage> *list)
+{
+    QQuickCLPipeline *pipeline = static_cast<QQuickCLPipeline *>(list->object);
+    QList<QQuickCLStage *> &stages(QQuickCLPipelinePrivate::get(pipeline)->stages);
+    for (int i = 0; i < stages.count(); ++i)
+        disconnect(stages[i], SIGNAL(changed()), pipeline, SLOT(update()));
+    stages.clear();
+    pipeline->update();
+}
+
+// The state of a stage, copied in synchronize() since the stages live on the
+// gui thread.
+struct QQuickCLStageState
+{
+    bool sameStructure(const QQuickCLStageState &other) const {
+        return kernel == other.kernel && inputs == other.inputs && output == other.output
+                && format == other.format && scale == other.scale;
+    }
+
+    QByteArray kernel;
+    QStringList inputs;
+    QString output;
+    QQuickCLStage::Format format;
+    qreal scale;
+    QVariantList argumentValues;
+    QVector<QByteArray> arguments; // raw values for clSetKernelArg(), empty when unsupported
+    bool argumentsConverted; // arguments is only filled once the kernel's parameter types are known
+};
+
+struct QQuickCLScratchImage
+{
+    cl_mem image;
+    QSize size;
+    QQuickCLStage::Format format;
+};
+
+class QQuickCLPipelineRunnable : public QQuickCLImageRunnable
+{
+public:
+    QQuickCLPipelineRunnable(QQuickCLPipeline *item);
+    ~QQuickCLPipelineRunnable();
+
+    void runKernel(cl_mem inImage, cl_mem outImage, const QSize &size) Q_DECL_OVERRIDE;
+    void synchronize() Q_DECL_OVERRIDE;
+
+private:
+    bool plan(const QSize &sourceSize);
+    bool visit(int stage, const QHash<QString, int> &producers, QVector<int> *state);
+    cl_mem scratchImage(const QQuickCLStageState &stage, const QSize &size);
+    void passthrough(cl_mem inImage, cl_mem outImage, const QSize &size);
+    void setProgram(const QString &program);
+    void destroyKernels();
+    int finalStage() const;
+    QSize stageSize(const QQuickCLStageState &stage, const QSize &sourceSize) const;
+
+    QQuickCLPipeline *m_item;
+    QQuickCLContext *m_clctx;
+    QString m_programSource;
+    QQuickCLProgramFuture m_program;
+    QVector<QQuickCLStageState> m_stages;
+    QString m_output;
+    QVector<QQuickCLKernel *> m_kernels; // per stage, created on first use
+
+    // The plan, valid for m_plannedSize
+    bool m_planDirty;
+    bool m_valid;
+    QSize m_plannedSize;
+    QVector<int> m_order; // stages in the order they run
+    QVector<int> m_targets; // per step: index in m_scratch, -1 for the output of the item
+    QVector<QVector<int> > m_stepInputs; // per step and input: index in m_scratch, -1 for the source
+    QVector<QQuickCLScratchImage> m_scratch;
+    QVector<QQuickCLScratchImage> m_pool; // scratch images of the previous plan
+};
+
+// Indexed by QQuickCLStage::Format
+static const cl_image_format stageFormatTable[] = {
+    { CL_RGBA, CL_UNORM_INT8 },
+    { CL_R, CL_UNORM_INT8 },
+    { CL_RG, CL_UNORM_INT8 },
+    { CL_RGBA, CL_HALF_FLOAT },
+    { CL_RGBA, CL_FLOAT },
+    { CL_R, CL_FLOAT }
+};
+
+QQuickCLPipelineRunnable::QQuickCLPipelineRunnable(QQuickCLPipeline *item)
+    : QQuickCLImageRunnable(item, PassthroughWhilePending | BatchedSubmission | SkipUnchanged),
+      m_item(item),
+      m_clctx(item->context()),
+      m_planDirty(true),
+      m_valid(false)
+{
+    // Start building right away, the gui thread is blocked.
+    setProgram(item->program());
+}
+
+QQuickCLPipelineRunnable::~QQuickCLPipelineRunnable()
+{
+    destroyKernels();
+    for (int i = 0; i < m_scratch.count(); ++i)
+        clReleaseMemObject(m_scratch[i].image);
+    for (int i = 0; i < m_pool.count(); ++i)
+        clReleaseMemObject(m_pool[i].image);
+}
+
+void QQuickCLPipelineRunnable::setProgram(const QString &program)
+{
+    m_programSource = program;
+    destroyKernels();
+    m_program = QQuickCLProgramFuture();
+    if (!program.isEmpty()) {
+        // Some implementations only report the parameter types, which the
+        // arguments are converted to, for programs built with this option.
+        const QByteArray version = m_clctx->deviceInfo().version();
+        const bool argInfo = version.startsWith("OpenCL ") && version.mid(7, 3) >= "1.2";
+        m_program = m_clctx->buildProgramAsync(program.toUtf8(), argInfo ? QByteArrayLiteral("-cl-kernel-arg-info") : QByteArray());
+        addPendingProgram(m_program);
+    }
+}
+
+void QQuickCLPipelineRunnable::destroyKernels()
+{
+    qDeleteAll(m_kernels);
+    m_kernels.clear();
+}
+
+// Derives the type from value, used when the kernel's parameter types are
+// not available.
+static QByteArray guessedKernelArgument(const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    {
+        const cl_int v = value.toInt();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::UInt:
+    {
+        const cl_uint v = value.toUInt();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::LongLong:
+    {
+        const cl_long v = value.toLongLong();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::ULongLong:
+    {
+        const cl_ulong v = value.toULongLong();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::Double:
+    case QMetaType::Float:
+    {
+        const cl_float v = value.toFloat();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::QPoint:
+    case QMetaType::QPointF:
+    {
+        const QPointF p = value.toPointF();
+        cl_float2 v;
+        v.s[0] = p.x();
+        v.s[1] = p.y();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::QSize:
+    case QMetaType::QSizeF:
+    {
+        const QSizeF s = value.toSizeF();
+        cl_float2 v;
+        v.s[0] = s.width();
+        v.s[1] = s.height();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    case QMetaType::QColor:
+    {
+        const QColor c = value.value<QColor>();
+        cl_float4 v;
+        v.s[0] = c.redF();
+        v.s[1] = c.greenF();
+        v.s[2] = c.blueF();
+        v.s[3] = c.alphaF();
+        return QByteArray(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    default:
+        qWarning("CLPipeline: unsupported kernel argument type %s", value.typeName());
+        return QByteArray();
+    }
+}
+
+// Splits value into the components of an OpenCL scalar or vector.
+static bool argumentComponents(const QVariant &value, QVariantList *components)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+    case QMetaType::Float:
+        *components << value;
+        return true;
+    case QMetaType::QPoint:
+    case QMetaType::QPointF:
+    {
+        const QPointF p = value.toPointF();
+        *components << p.x() << p.y();
+        return true;
+    }
+    case QMetaType::QSize:
+    case QMetaType::QSizeF:
+    {
+        const QSizeF s = value.toSizeF();
+        *components << s.width() << s.height();
+        return true;
+    }
+    case QMetaType::QColor:
+    {
+        const QColor c = value.value<QColor>();
+        *components << c.redF() << c.greenF() << c.blueF() << c.alphaF();
+        return true;
+    }
+    case QMetaType::QVector2D:
+    {
+        const QVector2D v = value.value<QVector2D>();
+        *components << v.x() << v.y();
+        return true;
+    }
+    case QMetaType::QVector3D:
+    {
+        const QVector3D v = value.value<QVector3D>();
+        *components << v.x() << v.y() << v.z();
+        return true;
+    }
+    case QMetaType::QVector4D:
+    {
+        const QVector4D v = value.value<QVector4D>();
+        *components << v.x() << v.y() << v.z() << v.w();
+        return true;
+    }
+    case QMetaType::QVariantList:
+    {
+        const QVariantList list = value.toList();
+        for (int i = 0; i < list.count(); ++i) {
+            QVariantList scalar;
+            if (!argumentComponents(list[i], &scalar) || scalar.count() != 1)
+                return false;
+            *components << scalar;
+        }
+        return !list.isEmpty();
+    }
+    default:
+        return false;
+    }
+}
+
+template <typename T>
+static void appendArgumentValue(QByteArray *data, T v)
+{
+    data->append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+// Converts value to the OpenCL C type typeName, as reported by
+// QQuickCLKernel::argumentTypeName(). Returns an empty array when the value
+// cannot be converted.
+static QByteArray kernelArgument(const QVariant &value, QByteArray typeName)
+{
+    if (typeName.isEmpty())
+        return guessedKernelArgument(value);
+
+    if (typeName.startsWith("unsigned "))
+        typeName = 'u' + typeName.mid(9);
+    int baseLength = typeName.size();
+    while (baseLength > 0 && typeName.at(baseLength - 1) >= '0' && typeName.at(baseLength - 1) <= '9')
+        --baseLength;
+    const int width = baseLength < typeName.size() ? typeName.mid(baseLength).toInt() : 1;
+    const QByteArray base = typeName.left(baseLength);
+
+    static const char *const scalarTypes[] = {
+        "char", "uchar", "short", "ushort", "int", "uint", "long", "ulong", "float", "double"
+    };
+    int scalarType = -1;
+    for (int i = 0; i < int(sizeof(scalarTypes) / sizeof(scalarTypes[0])); ++i) {
+        if (base == scalarTypes[i])
+            scalarType = i;
+    }
+    QVariantList components;
+    if (scalarType < 0 || !argumentComponents(value, &components) || components.count() != width) {
+        qWarning("CLPipeline: cannot pass a value of type %s for a kernel parameter of type %s",
+                 value.typeName(), typeName.constData());
+        return QByteArray();
+    }
+
+    // 3-component vectors have the size and alignment of 4-component ones.
+    if (width == 3)
+        components << 0;
+    QByteArray data;
+    for (int i = 0; i < components.count(); ++i) {
+        const QVariant &c(components[i]);
+        switch (scalarType) {
+        case 0: appendArgumentValue(&data, cl_char(c.toInt())); break;
+        case 1: appendArgumentValue(&data, cl_uchar(c.toUInt())); break;
+        case 2: appendArgumentValue(&data, cl_short(c.toInt())); break;
+        case 3: appendArgumentValue(&data, cl_ushort(c.toUInt())); break;
+        case 4: appendArgumentValue(&data, cl_int(c.toInt())); break;
+        case 5: appendArgumentValue(&data, cl_uint(c.toUInt())); break;
+        case 6: appendArgumentValue(&data, cl_long(c.toLongLong())); break;
+        case 7: appendArgumentValue(&data, cl_ulong(c.toULongLong())); break;
+        case 8: appendArgumentValue(&data, cl_float(c.toFloat())); break;
+        default: appendArgumentValue(&data, cl_double(c.toDouble())); break;
+        }
+    }
+    return data;
+}
+
+void QQuickCLPipelineRunnable::synchronize()
+{
+    // render thread, gui thread blocked
+    if (m_item->program() != m_programSource) {
+        setProgram(m_item->program());
+        markDirty();
+    }
+
+    const QList<QQuickCLStage *> stageList = m_item->stageList();
+    QVector<QQuickCLStageState> stages;
+    stages.reserve(stageList.count());
+    for (int i = 0; i < stageList.count(); ++i) {
+        const QQuickCLStage *stage = stageList[i];
+        QQuickCLStageState state;
+        state.kernel = stage->kernel().toUtf8();
+        state.inputs = stage->inputs();
+        state.output = stage->output();
+        state.format = stage->format();
+        state.scale = stage->scale();
+        state.argumentValues = stage->arguments();
+        state.argumentsConverted = false;
+        stages.append(state);
+    }
+
+    bool structureChanged = stages.count() != m_stages.count() || m_item->output() != m_output;
+    bool argumentsChanged = false;
+    for (int i = 0; i < stages.count() && !structureChanged; ++i) {
+        structureChanged = !stages[i].sameStructure(m_stages[i]);
+        argumentsChanged |= stages[i].argumentValues != m_stages[i].argumentValues;
+    }
+    if (structureChanged) {
+        destroyKernels();
+        m_planDirty = true;
+    }
+    if (structureChanged || argumentsChanged) {
+        // The values are converted in runKernel(), once per change, so that
+        // unsupported values are reported once. Stages disabled because of
+        // their arguments get another chance.
+        if (!m_valid)
+            m_planDirty = true;
+        m_stages = stages;
+        m_output = m_item->output();
+        markDirty();
+    }
+
+    // The final stage writes the item's texture. The size of the texture for
+    // this update is already known, a new scale takes effect with the next one.
+    const int last = finalStage();
+    if (structureChanged && last >= 0) {
+        if (!setOutputFormat(OutputFormat(m_stages[last].format)))
+            qWarning("CLPipeline: keeping the previous output format, the format of stage output '%s' cannot be used",
+                     qPrintable(m_stages[last].output));
+        setOutputScale(m_stages[last].scale);
+        if (outputSize() != stageSize(m_stages[last], inputSize()))
+            m_item->scheduleUpdate();
+    }
+}
+
+int QQuickCLPipelineRunnable::finalStage() const
+{
+    if (m_output.isEmpty())
+        return m_stages.count() - 1;
+    for (int i = 0; i < m_stages.count(); ++i) {
+        if (m_stages[i].output == m_output)
+            return i;
+    }
+    return -1;
+}
+
+// Capped like the item's output in QQuickCLImageRunnable, so that the final
+// stage's size matches the output and scratch images can be created.
+QSize QQuickCLPipelineRunnable::stageSize(const QQuickCLStageState &stage, const QSize &sourceSize) const
+{
+    QSize size(qMax(1, qRound(sourceSize.width() * stage.scale)),
+               qMax(1, qRound(sourceSize.height() * stage.scale)));
+    const QSize maxSize = m_clctx->deviceInfo().image2DMaxSize();
+    if (!maxSize.isEmpty())
+        size = size.boundedTo(maxSize);
+    return size;
+}
+
+// Adds stage to m_order after the stages producing its inputs.
+bool QQuickCLPipelineRunnable::visit(int stage, const QHash<QString, int> &producers, QVector<int> *state)
+{
+    if ((*state)[stage] == 2)
+        return true;
+    if ((*state)[stage] == 1) {
+        qWarning("CLPipeline: cycle involving stage output '%s'", qPrintable(m_stages[stage].output));
+        return false;
+    }
+    (*state)[stage] = 1;
+    const QStringList &inputs(m_stages[stage].inputs);
+    for (int i = 0; i < inputs.count(); ++i) {
+        if (inputs[i] == QLatin1String("source"))
+            continue;
+        if (!producers.contains(inputs[i])) {
+            qWarning("CLPipeline: no stage produces input '%s'", qPrintable(inputs[i]));
+            return false;
+        }
+        if (!visit(producers.value(inputs[i]), producers, state))
+            return false;
+    }
+    (*state)[stage] = 2;
+    m_order.append(stage);
+    return true;
+}
+
+cl_mem QQuickCLPipelineRunnable::scratchImage(const QQuickCLStageState &stage, const QSize &size)
+{
+    for (int i = 0; i < m_pool.count(); ++i) {
+        if (m_pool[i].size == size && m_pool[i].format == stage.format) {
+            const cl_mem image = m_pool[i].image;
+            m_pool.remove(i);
+            return image;
+        }
+    }
+    if (!m_clctx->isImageFormatSupported(stageFormatTable[stage.format], CL_MEM_READ_WRITE)) {
+        qWarning("CLPipeline: format %d of stage output '%s' is not supported by the OpenCL implementation",
+                 stage.format, qPrintable(stage.output));
+        return 0;
+    }
+    cl_int err = 0;
+    cl_mem image = clCreateImage2D(m_clctx->context(), CL_MEM_READ_WRITE, &stageFormatTable[stage.format],
+                                   size.width(), size.height(), 0, 0, &err);
+    if (!image)
+        qWarning("CLPipeline: failed to create OpenCL image for stage output '%s': %d", qPrintable(stage.output), err);
+    return image;
+}
+
+// Orders the stages and assigns scratch images to the intermediate outputs.
+// An image is reused by a later stage once all readers of its contents have
+// run, which makes chains of passes alternate between very few images.
+bool QQuickCLPipelineRunnable::plan(const QSize &sourceSize)
+{
+    m_order.clear();
+    m_targets.clear();
+    m_stepInputs.clear();
+    m_pool += m_scratch;
+    m_scratch.clear();
+
+    QHash<QString, int> producers;
+    for (int i = 0; i < m_stages.count(); ++i) {
+        const QString &name(m_stages[i].output);
+        if (name.isEmpty() || name == QLatin1String("source") || producers.contains(name)) {
+            qWarning("CLPipeline: invalid or duplicate stage output name '%s'", qPrintable(name));
+            return false;
+        }
+        producers.insert(name, i);
+    }
+    const int last = finalStage();
+    if (last < 0) {
+        qWarning("CLPipeline: no stage produces output '%s'", qPrintable(m_output));
+        return false;
+    }
+    QVector<int> state(m_stages.count(), 0); // not visited, visiting, done
+    if (!visit(last, producers, &state))
+        return false;
+
+    const int steps = m_order.count();
+    QVector<int> position(m_stages.count(), -1);
+    for (int p = 0; p < steps; ++p)
+        position[m_order[p]] = p;
+    QVector<int> lastUse(steps, -1);
+    for (int p = 0; p < steps; ++p) {
+        const QStringList &inputs(m_stages[m_order[p]].inputs);
+        for (int i = 0; i < inputs.count(); ++i) {
+            if (inputs[i] != QLatin1String("source")) {
+                const int producer = position[producers.value(inputs[i])];
+                lastUse[producer] = qMax(lastUse[producer], p);
+            }
+        }
+    }
+
+    // The final stage always comes last and writes the item's texture.
+    QVector<int> busyUntil; // per scratch image: the last step reading its current contents
+    m_targets.resize(steps);
+    m_stepInputs.resize(steps);
+    for (int p = 0; p < steps; ++p) {
+        const QQuickCLStageState &stage(m_stages[m_order[p]]);
+        const QStringList &inputs(stage.inputs);
+        for (int i = 0; i < inputs.count(); ++i)
+            m_stepInputs[p].append(inputs[i] == QLatin1String("source") ? -1 : m_targets[position[producers.value(inputs[i])]]);
+
+        if (p == steps - 1) {
+            m_targets[p] = -1;
+            break;
+        }
+        const QSize size = stageSize(stage, sourceSize);
+        int target = -1;
+        for (int s = 0; s < m_scratch.count() && target < 0; ++s) {
+            if (busyUntil[s] < p && m_scratch[s].size == size && m_scratch[s].format == stage.format)
+                target = s;
+        }
+        if (target < 0) {
+            QQuickCLScratchImage scratch;
+            scratch.image = scratchImage(stage, size);
+            scratch.size = size;
+            scratch.format = stage.format;
+            if (!scratch.image)
+                return false;
+            m_scratch.append(scratch);
+            busyUntil.append(-1);
+            target = m_scratch.count() - 1;
+        }
+        busyUntil[target] = lastUse[p];
+        m_targets[p] = target;
+    }
+
+    // What the new plan did not take from the previous one is not needed anymore.
+    for (int i = 0; i < m_pool.count(); ++i)
+        clReleaseMemObject(m_pool[i].image);
+    m_pool.clear();
+
+    qCDebug(logCL, "Planned pipeline with %d stages and %d scratch images", steps, m_scratch.count());
+    return true;
+}
+
+// Gives the output defined contents when the stages cannot run: the source
+// when it has the same format and size, transparent black otherwise.
+void QQuickCLPipelineRunnable::passthrough(cl_mem inImage, cl_mem outImage, const QSize &size)
+{
+    const size_t origin[3] = { 0, 0, 0 };
+    const size_t region[3] = { size_t(size.width()), size_t(size.height()), 1 };
+    cl_image_format inFormat, outFormat;
+    if (inputSize() == size
+            && clGetImageInfo(inImage, CL_IMAGE_FORMAT, sizeof(inFormat), &inFormat, 0) == CL_SUCCESS
+            && clGetImageInfo(outImage, CL_IMAGE_FORMAT, sizeof(outFormat), &outFormat, 0) == CL_SUCCESS
+            && inFormat.image_channel_order == outFormat.image_channel_order
+            && inFormat.image_channel_data_type == outFormat.image_channel_data_type
+            && clEnqueueCopyImage(commandQueue(), inImage, outImage, origin, origin, region, 0, 0, 0) == CL_SUCCESS)
+        return;
+
+    size_t elementSize = 0;
+    cl_int err = clGetImageInfo(outImage, CL_IMAGE_ELEMENT_SIZE, sizeof(elementSize), &elementSize, 0);
+    if (err == CL_SUCCESS) {
+        // Blocking, so the temporary data does not have to outlive the call. Failures are rare.
+        const QByteArray zeros(int(elementSize) * size.width() * size.height(), 0);
+        err = clEnqueueWriteImage(commandQueue(), outImage, CL_TRUE, origin, region, 0, 0, zeros.constData(), 0, 0, 0);
+    }
+    if (err != CL_SUCCESS)
+        qWarning("CLPipeline: failed to clear the output: %d", err);
+}
+
+void QQuickCLPipelineRunnable::runKernel(cl_mem inImage, cl_mem outImage, const QSize &size)
+{
+    if (!m_program.program()) {
+        // Not built yet, or the build failed. Try again with the next update.
+        markDirty();
+        passthrough(inImage, outImage, size);
+        return;
+    }
+
+    if (m_planDirty || inputSize() != m_plannedSize) {
+        m_planDirty = false;
+        m_plannedSize = inputSize();
+        m_valid = plan(m_plannedSize);
+    }
+    if (!m_valid) {
+        passthrough(inImage, outImage, size);
+        return;
+    }
+
+    if (m_kernels.isEmpty())
+        m_kernels.resize(m_stages.count());
+
+    for (int p = 0; p < m_order.count(); ++p) {
+        QQuickCLStageState &stage(m_stages[m_order[p]]);
+        QQuickCLKernel *&kernel(m_kernels[m_order[p]]);
+        if (!kernel) {
+            kernel = new QQuickCLKernel;
+            if (!kernel->create(m_program.program(), stage.kernel.constData())) {
+                // Do not warn on every frame, wait for the stages to change.
+                m_valid = false;
+                passthrough(inImage, outImage, size);
+                return;
+            }
+        }
+
+        // A stage with arguments that cannot be set is not dispatched. Do not
+        // warn on every frame, wait for the stages or their arguments to change.
+        bool ok = true;
+        int arg = 0;
+        for (int i = 0; i < m_stepInputs[p].count(); ++i) {
+            const int input = m_stepInputs[p][i];
+            ok &= kernel->setArgument(arg++, input < 0 ? inImage : m_scratch[input].image);
+        }
+        const int target = m_targets[p];
+        ok &= kernel->setArgument(arg++, target < 0 ? outImage : m_scratch[target].image);
+        if (!stage.argumentsConverted) {
+            // Converted to the types of the parameters, when known, instead of
+            // relying on how QML happened to store the numbers.
+            stage.arguments.clear();
+            for (int i = 0; i < stage.argumentValues.count(); ++i)
+                stage.arguments.append(kernelArgument(stage.argumentValues[i], kernel->argumentTypeName(arg + i)));
+            stage.argumentsConverted = true;
+        }
+        for (int i = 0; i < stage.arguments.count() && ok; ++i) {
+            const QByteArray &value(stage.arguments[i]);
+            ok = !value.isEmpty() && kernel->setArgumentData(arg++, value.constData(), value.size());
+        }
+        if (!ok) {
+            qWarning("CLPipeline: failed to set the arguments of kernel '%s', skipping the pipeline",
+                     stage.kernel.constData());
+            m_valid = false;
+            passthrough(inImage, outImage, size);
+            return;
+        }
+
+        const QSize stageOutputSize = target < 0 ? size : m_scratch[target].size;
+        const cl_int err = kernel->dispatch(commandQueue(), QQuickCLKernel::Range(stageOutputSize));
+        if (err != CL_SUCCESS) {
+            qWarning("Failed to enqueue kernel '%s' of pipeline stage: %d", stage.kernel.constData(), err);
+            passthrough(inImage, outImage, size);
+            return;
+        }
+    }
+}
+
+/*!
+    \internal
+ */
+QQuickCLRunnable *QQuickCLPipeline::createCL()
+{
+    return new QQuickCLPipelineRunnable(this);
+}
+
+QT_END_NAMESPACE
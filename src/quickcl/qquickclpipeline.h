@@ -0,0 +1,146 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QQUICKCLPIPELINE_H
+#define QQUICKCLPIPELINE_H
+
+#include <QtQuickCL/qtquickclglobal.h>
+#include <QtQuickCL/qquickclitem.h>
+#include <QtQml/qqmllist.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qvariant.h>
+
+QT_BEGIN_NAMESPACE
+
+class QQuickCLStagePrivate;
+class QQuickCLPipelinePrivate;
+
+class Q_QUICKCL_EXPORT QQuickCLStage : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(QQuickCLStage)
+    Q_PROPERTY(QString kernel READ kernel WRITE setKernel NOTIFY kernelChanged)
+    Q_PROPERTY(QStringList inputs READ inputs WRITE setInputs NOTIFY inputsChanged)
+    Q_PROPERTY(QString output READ output WRITE setOutput NOTIFY outputChanged)
+    Q_PROPERTY(Format format READ format WRITE setFormat NOTIFY formatChanged)
+    Q_PROPERTY(qreal scale READ scale WRITE setScale NOTIFY scaleChanged)
+    Q_PROPERTY(QVariantList arguments READ arguments WRITE setArguments NOTIFY argumentsChanged)
+    Q_ENUMS(Format)
+
+public:
+    // Same values as QQuickCLImageRunnable::OutputFormat
+    enum Format {
+        RGBA8,
+        R8,
+        RG8,
+        RGBA16F,
+        RGBA32F,
+        R32F
+    };
+
+    QQuickCLStage(QObject *parent = 0);
+
+    QString kernel() const;
+    void setKernel(const QString &kernel);
+
+    QStringList inputs() const;
+    void setInputs(const QStringList &inputs);
+
+    QString output() const;
+    void setOutput(const QString &output);
+
+    Format format() const;
+    void setFormat(Format format);
+
+    qreal scale() const;
+    void setScale(qreal scale);
+
+    QVariantList arguments() const;
+    void setArguments(const QVariantList &arguments);
+
+signals:
+    void kernelChanged();
+    void inputsChanged();
+    void outputChanged();
+    void formatChanged();
+    void scaleChanged();
+    void argumentsChanged();
+    void changed();
+};
+
+class Q_QUICKCL_EXPORT QQuickCLPipeline : public QQuickCLItem
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(QQuickCLPipeline)
+    Q_PROPERTY(QQuickItem *source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QString program READ program WRITE setProgram NOTIFY programChanged)
+    Q_PROPERTY(QString output READ output WRITE setOutput NOTIFY outputChanged)
+    Q_PROPERTY(QQmlListProperty<QQuickCLStage> stages READ stages)
+    Q_CLASSINFO("DefaultProperty", "stages")
+
+public:
+    QQuickCLPipeline(QQuickItem *parent = 0);
+
+    QQuickItem *source() const;
+    void setSource(QQuickItem *source);
+
+    QString program() const;
+    void setProgram(const QString &program);
+
+    QString output() const;
+    void setOutput(const QString &output);
+
+    QQmlListProperty<QQuickCLStage> stages();
+    QList<QQuickCLStage *> stageList() const;
+
+signals:
+    void sourceChanged();
+    void programChanged();
+    void outputChanged();
+
+protected:
+    QQuickCLRunnable *createCL() Q_DECL_OVERRIDE;
+
+private:
+    static void appendStage(QQmlListProperty<QQuickCLStage> *list, QQuickCLStage *stage);
+    static int stageCount(QQmlListProperty<QQuickCLStage> *list);
+    static QQuickCLStage *stageAt(QQmlListProperty<QQuickCLStage> *list, int index);
+    static void clearStages(QQmlListProperty<QQuickCLStage> *list);
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,193 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qquickclprogramfuture_p.h"
+#include "qquickclitem_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QQuickCLProgramFuture
+
+    \brief QQuickCLProgramFuture represents the result of an OpenCL program
+    build running in the background.
+
+    Instances are returned from QQuickCLContext::buildProgramAsync(). The
+    class is implicitly shared: copies refer to the same build.
+
+    Checking isFinished() never blocks. This allows a QQuickCLRunnable to keep
+    providing placeholder content from its \l{QQuickCLRunnable::update()}{update()}
+    function while the driver is compiling. To get the item updated once the
+    program is ready, call notifyWhenFinished().
+
+    \sa QQuickCLImageRunnable::addPendingProgram()
+ */
+
+QQuickCLProgramFuturePrivate::~QQuickCLProgramFuturePrivate()
+{
+    if (program)
+        clReleaseProgram(program);
+    for (int i = 0; i < watchers.count(); ++i)
+        watchers[i]->deref();
+}
+
+void QQuickCLProgramFuturePrivate::finish(cl_program prog)
+{
+    // worker thread. The items may be destroyed concurrently, so they are
+    // only reached via their event channels.
+    QVector<QQuickCLEventChannel *> channels;
+    {
+        QMutexLocker lock(&mutex);
+        program = prog;
+        finished = true;
+        channels = watchers;
+        watchers.clear();
+        cond.wakeAll();
+    }
+    for (int i = 0; i < channels.count(); ++i) {
+        channels[i]->scheduleUpdate();
+        channels[i]->deref();
+    }
+}
+
+/*!
+    Constructs an invalid future.
+ */
+QQuickCLProgramFuture::QQuickCLProgramFuture()
+{
+}
+
+QQuickCLProgramFuture::QQuickCLProgramFuture(QQuickCLProgramFuturePrivate *d)
+    : d(d)
+{
+}
+
+/*!
+    Constructs a copy of \a other.
+ */
+QQuickCLProgramFuture::QQuickCLProgramFuture(const QQuickCLProgramFuture &other)
+    : d(other.d)
+{
+}
+
+/*!
+    Assigns \a other to this future.
+ */
+QQuickCLProgramFuture &QQuickCLProgramFuture::operator=(const QQuickCLProgramFuture &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Destroys the future. The program is released when the last future
+    referring to it is destroyed. A build that is still running is not
+    cancelled.
+ */
+QQuickCLProgramFuture::~QQuickCLProgramFuture()
+{
+}
+
+/*!
+    \return \c true if the future refers to a build.
+ */
+bool QQuickCLProgramFuture::isValid() const
+{
+    return d.constData() != 0;
+}
+
+/*!
+    \return \c true if the build has completed, regardless of whether it was
+    successful. Does not block.
+ */
+bool QQuickCLProgramFuture::isFinished() const
+{
+    if (!d)
+        return true;
+    QMutexLocker lock(&d->mutex);
+    return d->finished;
+}
+
+/*!
+    Blocks until the build has completed.
+ */
+void QQuickCLProgramFuture::waitForFinished() const
+{
+    if (!d)
+        return;
+    QMutexLocker lock(&d->mutex);
+    while (!d->finished)
+        d->cond.wait(&d->mutex);
+}
+
+/*!
+    \return the built program or \c 0 if the build is not yet finished or it
+    failed.
+
+    The program is owned by the future. Call \c clRetainProgram() when the
+    program needs to outlive all copies of the future.
+ */
+cl_program QQuickCLProgramFuture::program() const
+{
+    if (!d)
+        return 0;
+    QMutexLocker lock(&d->mutex);
+    return d->program;
+}
+
+/*!
+    Requests calling QQuickCLItem::scheduleUpdate() on \a item when the build
+    completes. When the build has already completed, the update is scheduled
+    immediately. Destroying \a item before the build completes is safe.
+
+    \note Call this function on the gui thread, or on the render thread while
+    the gui thread is blocked, for example from QQuickCLRunnable::update().
+ */
+void QQuickCLProgramFuture::notifyWhenFinished(QQuickCLItem *item)
+{
+    if (!d || !item)
+        return;
+    {
+        QMutexLocker lock(&d->mutex);
+        if (!d->finished) {
+            d->watchers.append(QQuickCLEventChannel::acquire(item));
+            return;
+        }
+    }
+    item->scheduleUpdate();
+}
+
+QT_END_NAMESPACE
@@ -47,6 +47,8 @@ class Q_QUICKCL_EXPORT QQuickCLRunnable
 public:
     virtual ~QQuickCLRunnable();
     virtual QSGNode *update(QSGNode *node) = 0;
+    virtual void eventCompletedOnRenderThread(cl_event event);
+    virtual void aboutToBeDeleted();
 };
 
 QT_END_NAMESPACE
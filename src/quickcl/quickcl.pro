@@ -7,15 +7,31 @@ DEFINES += QT_BUILD_QUICKCL_LIB
 
 HEADERS = \
     qtquickclglobal.h \
+    qtquickclglobal_p.h \
     qquickclcontext.h \
+    qquickclcontext_p.h \
     qquickclitem.h \
+    qquickclitem_p.h \
     qquickclrunnable.h \
-    qquickclimagerunnable.h
+    qquickclimagerunnable.h \
+    qquickclprogramfuture.h \
+    qquickclprogramfuture_p.h \
+    qquickcldeviceinfo.h \
+    qquickclkernel.h \
+    qquickclpipeline.h \
+    qquickclframescheduler_p.h \
+    qquickclcomputethread_p.h
 
 SOURCES = \
     qquickclcontext.cpp \
     qquickclitem.cpp \
-    qquickclimagerunnable.cpp
+    qquickclimagerunnable.cpp \
+    qquickclprogramfuture.cpp \
+    qquickcldeviceinfo.cpp \
+    qquickclkernel.cpp \
+    qquickclpipeline.cpp \
+    qquickclframescheduler.cpp \
+    qquickclcomputethread.cpp
 
 QMAKE_DOCS = $$PWD/doc/qtquickcl.qdocconf
 
@@ -1,3 +1,6 @@
 TEMPLATE = subdirs
 SUBDIRS += \
-    quickcl
+    quickcl \
+    tools
+
+tools.depends = quickcl
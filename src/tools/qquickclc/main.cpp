@@ -0,0 +1,200 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the tools of the Qt Quick CL module
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+// Compiles OpenCL programs for the devices available on the build machine and
+// generates a resource collection file with the binaries. The binaries are
+// found at runtime by QQuickCLContext::buildProgram() as long as the source,
+// the build options and the device match.
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QVector>
+#include <QtQuickCL/private/qquickclcontext_p.h>
+#include <stdio.h>
+
+static cl_device_type parseDeviceType(const QString &s)
+{
+    if (s == QLatin1String("gpu"))
+        return CL_DEVICE_TYPE_GPU;
+    if (s == QLatin1String("cpu"))
+        return CL_DEVICE_TYPE_CPU;
+    if (s == QLatin1String("accelerator"))
+        return CL_DEVICE_TYPE_ACCELERATOR;
+    if (s == QLatin1String("all"))
+        return CL_DEVICE_TYPE_ALL;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("qquickclc"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Qt Quick CL program compiler"));
+    parser.addHelpOption();
+    QCommandLineOption deviceTypeOption(QStringLiteral("device-type"),
+                                        QStringLiteral("Compile for devices of <type> (gpu, cpu, accelerator, all). "
+                                                       "Can be given multiple times. Defaults to gpu."),
+                                        QStringLiteral("type"));
+    parser.addOption(deviceTypeOption);
+    QCommandLineOption buildOptionsOption(QStringLiteral("build-options"),
+                                          QStringLiteral("Options passed to clBuildProgram."),
+                                          QStringLiteral("options"));
+    parser.addOption(buildOptionsOption);
+    QCommandLineOption defineOption(QStringLiteral("D"),
+                                    QStringLiteral("Define <name> or <name>=<value>."),
+                                    QStringLiteral("define"));
+    parser.addOption(defineOption);
+    QCommandLineOption outputOption(QStringLiteral("o"),
+                                    QStringLiteral("Write the resource collection file to <file>. "
+                                                   "Binaries are placed next to it."),
+                                    QStringLiteral("file"));
+    parser.addOption(outputOption);
+    parser.addPositionalArgument(QStringLiteral("source"), QStringLiteral("OpenCL source file."));
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1 || !parser.isSet(outputOption))
+        parser.showHelp(1);
+
+    const QString sourceFileName = parser.positionalArguments().first();
+    QFile sourceFile(sourceFileName);
+    // Read the same way as QQuickCLContext::buildProgramFromFile() does, the
+    // program key depends on the exact contents.
+    if (!sourceFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        fprintf(stderr, "qquickclc: Failed to open %s\n", qPrintable(sourceFileName));
+        return 1;
+    }
+    const QByteArray src = sourceFile.readAll();
+
+    QQuickCLContext::DefineMap defines;
+    foreach (const QString &define, parser.values(defineOption)) {
+        const int eq = define.indexOf(QLatin1Char('='));
+        if (eq < 0)
+            defines.insert(define.toUtf8(), QByteArray());
+        else
+            defines.insert(define.left(eq).toUtf8(), define.mid(eq + 1).toUtf8());
+    }
+    const QByteArray options = QQuickCLContext::buildOptions(parser.value(buildOptionsOption).toUtf8(), defines);
+
+    cl_device_type deviceType = 0;
+    QStringList deviceTypes = parser.values(deviceTypeOption);
+    if (deviceTypes.isEmpty())
+        deviceTypes.append(QStringLiteral("gpu"));
+    foreach (const QString &type, deviceTypes) {
+        const cl_device_type t = parseDeviceType(type);
+        if (!t) {
+            fprintf(stderr, "qquickclc: Unknown device type %s\n", qPrintable(type));
+            return 1;
+        }
+        deviceType |= t;
+    }
+
+    // Only the binaries produced here are of interest.
+    QQuickCLContext::setProgramBinaryCacheDirectory(QString());
+
+    const QFileInfo outputInfo(parser.value(outputOption));
+    const QString binaryDirName = outputInfo.completeBaseName();
+    QDir outputDir = outputInfo.absoluteDir();
+    if (!outputDir.mkpath(binaryDirName)) {
+        fprintf(stderr, "qquickclc: Failed to create %s\n", qPrintable(outputDir.filePath(binaryDirName)));
+        return 1;
+    }
+
+    QStringList binaryFiles;
+    cl_uint platformCount = 0;
+    if (clGetPlatformIDs(0, 0, &platformCount) != CL_SUCCESS)
+        platformCount = 0;
+    QVector<cl_platform_id> platforms(platformCount);
+    if (platformCount)
+        clGetPlatformIDs(platformCount, platforms.data(), 0);
+
+    foreach (cl_platform_id platform, platforms) {
+        cl_uint deviceCount = 0;
+        if (clGetDeviceIDs(platform, deviceType, 0, 0, &deviceCount) != CL_SUCCESS || !deviceCount)
+            continue;
+        QVector<cl_device_id> devices(deviceCount);
+        clGetDeviceIDs(platform, deviceType, deviceCount, devices.data(), 0);
+        foreach (cl_device_id device, devices) {
+            QQuickCLContext context;
+            QQuickCLContextPrivate *d = QQuickCLContextPrivate::get(&context);
+            if (!d->createComputeOnly(platform, device))
+                return 1;
+            printf("qquickclc: Compiling %s for %s (%s)\n", qPrintable(sourceFileName),
+                   d->deviceInfo.name().constData(), d->deviceInfo.platformName().constData());
+            cl_program prog = d->compileProgram(src, options);
+            if (!prog)
+                return 1;
+            const QByteArray binary = QQuickCLContextPrivate::programBinary(prog);
+            clReleaseProgram(prog);
+            if (binary.isEmpty())
+                continue;
+            const QString binaryFileName = binaryDirName + QLatin1Char('/')
+                    + QString::fromLatin1(d->programKey(src, options)) + QStringLiteral(".bin");
+            QFile f(outputDir.filePath(binaryFileName));
+            if (!f.open(QIODevice::WriteOnly) || f.write(binary) != binary.size()) {
+                fprintf(stderr, "qquickclc: Failed to write %s\n", qPrintable(f.fileName()));
+                return 1;
+            }
+            if (!binaryFiles.contains(binaryFileName))
+                binaryFiles.append(binaryFileName);
+        }
+    }
+
+    if (binaryFiles.isEmpty())
+        fprintf(stderr, "qquickclc: Warning: No OpenCL devices found for %s, nothing is precompiled\n",
+                qPrintable(sourceFileName));
+
+    QFile qrc(outputInfo.absoluteFilePath());
+    if (!qrc.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        fprintf(stderr, "qquickclc: Failed to write %s\n", qPrintable(qrc.fileName()));
+        return 1;
+    }
+    qrc.write("<RCC>\n    <qresource prefix=\"/qt-project.org/quickcl/programs\">\n");
+    foreach (const QString &binaryFileName, binaryFiles) {
+        qrc.write("        <file alias=\"");
+        qrc.write(QFileInfo(binaryFileName).fileName().toUtf8());
+        qrc.write("\">");
+        qrc.write(binaryFileName.toUtf8());
+        qrc.write("</file>\n");
+    }
+    qrc.write("    </qresource>\n</RCC>\n");
+
+    return 0;
+}
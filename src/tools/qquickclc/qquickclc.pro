@@ -0,0 +1,16 @@
+QT = core quickcl-private
+CONFIG += console
+
+SOURCES = main.cpp
+
+osx: LIBS += -framework OpenCL
+unix: !osx: LIBS += -lOpenCL
+win32: !winrt: !wince*: LIBS += -lOpenCL
+
+build_integration.files = quickcl_kernels.prf
+build_integration.path = $$[QT_HOST_DATA]/mkspecs/features
+prefix_build: INSTALLS += build_integration
+else: COPIES += build_integration
+
+QMAKE_TARGET_DESCRIPTION = "Qt Quick CL Program Compiler"
+load(qt_tool)